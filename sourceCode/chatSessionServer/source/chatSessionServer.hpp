@@ -7,12 +7,16 @@
 #include "MChatSessionUser.hpp"
 #include "MChatSession.hpp"
 #include "channel.hpp"
+#include "redis.hpp"
+#include "userProfileCache.hpp"
+#include "fileUpload.hpp"
 #include "rabbitMQ.hpp"
 
 #include "base.pb.h"
 #include "user.pb.h"
 #include "chatSession.pb.h"
 #include "message.pb.h"
+#include "file.pb.h"
 
 namespace hjb
 {
@@ -22,29 +26,35 @@ namespace hjb
     private:
         std::string _userServiceName;        // 用户子服务的名称
         std::string _messageServiceName;     // 消息子服务名称
+        std::string _fileServiceName;        // 文件子服务名称
         AllServiceChannel::ptr _channels;    // 服务信道操作对象
         ChatSessionUserTable::ptr _csuTable; // 用户会话关联数据表操作对象
         MQClient::ptr _mqClient;             // rabbitMQ操作对象
         std::string _exchange;               // rabbitMQ交换机名称
         std::string _routing_key;            // rabbitMQ规则
         ChatSessionTable::ptr _mysql;        // 会话数据表操作对象
+        UserProfileCache::ptr _userCache;    // 用户信息获取对象(未开启缓存时直接调用用户子服务)
 
     public:
         ChatSessionServiceImpl(const std::shared_ptr<odb::core::database> &mysql,
                                    const AllServiceChannel::ptr &channels,
                                    const std::string &userServiceName,
                                    const std::string &messageServiceName,
+                                   const std::string &fileServiceName,
                                    const std::string &exchange,
                                    const std::string &routing_key,
-                                   const MQClient::ptr &mqClient)
+                                   const MQClient::ptr &mqClient,
+                                   const UserProfileCache::ptr &userCache)
             : _userServiceName(userServiceName),
               _messageServiceName(messageServiceName),
+              _fileServiceName(fileServiceName),
               _exchange(exchange),
               _routing_key(routing_key),
               _channels(channels),
               _csuTable(std::make_shared<ChatSessionUserTable>(mysql)),
               _mysql(std::make_shared<ChatSessionTable>(mysql)),
-              _mqClient(mqClient)
+              _mqClient(mqClient),
+              _userCache(userCache)
         {
         }
 
@@ -77,24 +87,12 @@ namespace hjb
             auto chatSessionId = request->chatsessionid();      // 所属聊天会话id
             const MessageContent &content = request->message(); // 消息数据
 
-            // 向用户子服务获取发送者的用户数据
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到用户管理子服务节点 - {} - {}", requestId, _userServiceName, userId);
-                return err(request->requestid(), "未找到用户管理子服务节点");
-            }
-            GetUserInfoReq req;
-            GetUserInfoResp resp;
-            brpc::Controller cntl;
-            UserService_Stub stub(channel.get());
-            req.set_requestid(requestId);
-            req.set_userid(userId);
-            stub.GetUserInfo(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
+            // 获取发送者的用户数据(头像只携带文件id，消息队列与推送中不含头像数据)
+            std::unordered_map<std::string, UserProto> senders;
+            if (!_getUser(requestId, {userId}, senders) || senders.find(userId) == senders.end())
             {
-                ERROR("{} - 用户子服务调用失败：{}", request->requestid(), cntl.ErrorText());
-                return err(request->requestid(), "用户子服务调用失败");
+                ERROR("{} - 获取发送者用户信息失败 - {}", requestId, userId);
+                return err(requestId, "获取发送者用户信息失败");
             }
 
             // 组织最终消息数据
@@ -102,16 +100,21 @@ namespace hjb
             message.set_messageid(uuid());
             message.set_chatsessionid(chatSessionId);
             message.set_timestamp(time(nullptr));
-            message.mutable_sender()->CopyFrom(resp.user());
+            message.mutable_sender()->CopyFrom(senders[userId]);
             message.mutable_message()->CopyFrom(content);
 
+            // 消息中直接携带的媒体数据先存入文件子服务，消息队列与推送中只保留文件id
+            std::string mediaErr = _putMedia(requestId, userId, *message.mutable_message());
+            if (!mediaErr.empty())
+                return err(requestId, mediaErr);
+
             // 获取该聊天会话中的所有用户
             auto ids = _csuTable->all(chatSessionId);
 
             // 将组织好的消息发布到rabbitMQ消息队列
             if (!_mqClient->publish(_exchange, message.SerializeAsString(), _routing_key))
             {
-                ERROR("{} - 持久化消息发布失败：{}", requestId, cntl.ErrorText());
+                ERROR("{} - 持久化消息发布失败", requestId);
                 return err(requestId, "持久化消息发布失败");
             }
 
@@ -171,7 +174,7 @@ namespace hjb
                 sessionInfo->set_singlechatfriendid(session.friendId);
                 sessionInfo->set_chatsessionid(session.chatSessionId);
                 sessionInfo->set_chatsessionname(friends[session.friendId].nickname());
-                sessionInfo->set_photo(friends[session.friendId].photo());
+                sessionInfo->set_photoid(friends[session.friendId].photoid());
                 // 获取最近一条消息
                 MessageInfo msg;
                 if (!_getRecentMsg(requestId, session.chatSessionId, msg))
@@ -294,11 +297,72 @@ namespace hjb
         }
 
     private:
+        // 代发送者上传一份媒体数据，数据交给上传请求后body被清空
+        bool _putFile(const std::string &rid,
+                      const std::string &userId,
+                      const std::string &fileName,
+                      std::string *body,
+                      std::string &fileId)
+        {
+            auto channel = _channels->choose(_fileServiceName);
+            if (!channel)
+            {
+                ERROR("{} - 未找到文件管理子服务节点 - {}", rid, _fileServiceName);
+                return false;
+            }
+
+            return FileUploader::put(channel.get(), rid, userId, fileName, body, fileId);
+        }
+
+        // 将消息中的媒体数据替换为文件id
+        // 已经先行上传(只携带文件id)的消息只接受发送者本人上传的文件，避免通过消息读取他人的文件
+        // 返回错误信息，成功时返回空串
+        std::string _putMedia(const std::string &rid, const std::string &userId, MessageContent &content)
+        {
+            std::string *fileId = nullptr;
+            std::string *body = nullptr;
+            std::string fileName;
+            switch (content.messagetype())
+            {
+            case MessageType::IMAGE:
+                fileId = content.mutable_imagemessage()->mutable_fileid();
+                body = content.mutable_imagemessage()->mutable_content();
+                break;
+            case MessageType::FILE:
+                fileId = content.mutable_filemessage()->mutable_fileid();
+                body = content.mutable_filemessage()->mutable_filecontent();
+                fileName = content.filemessage().filename();
+                break;
+            case MessageType::SPEECH:
+                fileId = content.mutable_speechmessage()->mutable_fileid();
+                body = content.mutable_speechmessage()->mutable_content();
+                break;
+            default:
+                return "";
+            }
+
+            if (!fileId->empty())
+            {
+                if (!FileUploader::ownedBy(*fileId, userId))
+                {
+                    ERROR("{} - 消息引用的文件 {} 不是发送者 {} 上传的", rid, *fileId, userId);
+                    return "消息引用的文件不属于发送者";
+                }
+                body->clear();
+                return "";
+            }
+
+            if (!_putFile(rid, userId, fileName, body, *fileId))
+                return "上传消息文件数据失败";
+            body->clear();
+            return "";
+        }
+
         bool _getRecentMsg(const std::string &rid,
                            const std::string &sid,
                            MessageInfo &msg)
         {
-            auto channel = _channels->choose(_messageServiceName);
+            auto channel = _channels->choose(_messageServiceName, sid);
             if (!channel)
             {
                 ERROR("{} - 获取消息子服务信道失败", rid);
@@ -335,43 +399,12 @@ namespace hjb
             return false;
         }
 
+        // 批量获取用户信息，开启缓存时优先从本地缓存获取
         bool _getUser(const std::string &rid,
                       const std::vector<std::string> &userIds,
                       std::unordered_map<std::string, UserProto> &users)
         {
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 获取用户子服务信道失败", rid);
-                return false;
-            }
-
-            GetMultiUserInfoReq req;
-            GetMultiUserInfoResp resp;
-            req.set_requestid(rid);
-            for (auto &id : userIds)
-                req.add_userids(id);
-
-            brpc::Controller cntl;
-            UserService_Stub stub(channel.get());
-            stub.GetMultiUserInfo(&cntl, &req, &resp, nullptr);
-
-            if (cntl.Failed())
-            {
-                ERROR("{} - 用户子服务调用失败: {}", rid, cntl.ErrorText());
-                return false;
-            }
-
-            if (!resp.success())
-            {
-                ERROR("{} - 批量获取用户信息失败: {}", rid, resp.errmsg());
-                return false;
-            }
-
-            for (const auto &user : resp.users())
-                users.insert(std::make_pair(user.first, user.second));
-
-            return true;
+            return _userCache->get(rid, userIds, users);
         }
     };
 
@@ -411,11 +444,12 @@ namespace hjb
     };
 
     // 聊天会话rpc服务器建造类
-    class ChatSessionServerBuild
+    class ChatSessionServerBuild : public UserProfileCacheBuilder
     {
     private:
         std::string _userServiceName;
         std::string _messageServiceName;
+        std::string _fileServiceName;
         EtcdDisClient::ptr _disClient;               // 服务发现操作对象
         std::shared_ptr<brpc::Server> _brpcServer;   // rpc服务器
         EtcdRegClient::ptr _regClient;               // 服务注册操作对象
@@ -444,13 +478,24 @@ namespace hjb
         void makeEtcdDis(const std::string &regHost,
                          const std::string &baseServiceName,
                          const std::string &userServiceName,
-                         const std::string &messageServiceName)
+                         const std::string &messageServiceName,
+                         const std::string &fileServiceName)
         {
             _userServiceName = userServiceName;
             _messageServiceName = messageServiceName;
+            _fileServiceName = fileServiceName;
             _channels = std::make_shared<hjb::AllServiceChannel>();
-            _channels->declared(_userServiceName);
-            _channels->declared(_messageServiceName);
+            // 批量获取用户信息与最近消息是幂等的读接口，开启请求对冲以削减尾延迟
+            ServiceOptions userOptions;
+            userOptions.hedgedMethods = {"GetMultiUserInfo"};
+            ServiceOptions messageOptions;
+            messageOptions.hedgedMethods = {"GetRecentMsg"};
+            _channels->declared(_userServiceName, userOptions);
+            _channels->declared(_messageServiceName, messageOptions);
+            // 消息中的媒体数据上传耗时较长，放宽时间预算
+            ServiceOptions fileOptions;
+            fileOptions.timeoutMs = 10000;
+            _channels->declared(_fileServiceName, fileOptions);
 
             auto putCb = std::bind(&hjb::AllServiceChannel::onServiceOnline, _channels.get(), std::placeholders::_1, std::placeholders::_2);
             auto delCb = std::bind(&hjb::AllServiceChannel::onServiceOffline, _channels.get(), std::placeholders::_1, std::placeholders::_2);
@@ -503,7 +548,7 @@ namespace hjb
 
             // 添加rpc服务
             _brpcServer = std::make_shared<brpc::Server>();
-            ChatSessionServiceImpl *chatSessionService = new ChatSessionServiceImpl(_mysql, _channels, _userServiceName, _messageServiceName, _exchange, _routing_key, _mqClient);
+            ChatSessionServiceImpl *chatSessionService = new ChatSessionServiceImpl(_mysql, _channels, _userServiceName, _messageServiceName, _fileServiceName, _exchange, _routing_key, _mqClient, buildUserCache(_channels, _userServiceName));
             if (_brpcServer->AddService(chatSessionService, brpc::ServiceOwnership::SERVER_OWNS_SERVICE) == -1)
             {
                 ERROR("添加Rpc服务失败");
@@ -1,14 +1,543 @@
 #include <vector>
 #include <mutex>
+#include <atomic>
 #include <unordered_map>
+#include <cmath>
+#include <algorithm>
 #include <memory>
+#include <string>
+#include <functional>
 #include <brpc/channel.h>
+#include <brpc/callback.h>
+#include <bthread/unstable.h>
+#include <bthread/countdown_event.h>
+#include <bvar/bvar.h>
+#include <butil/containers/doubly_buffered_data.h>
+#include <butil/fast_rand.h>
+#include <butil/time.h>
 
 #include "log.hpp"
 
 namespace hjb
 { 
+    // 负载均衡策略
+    enum class LoadBalance
+    {
+        ROUND_ROBIN,          // 轮转
+        WEIGHTED_ROUND_ROBIN, // 按节点注册时携带的权重平滑加权轮转
+        LEAST_OUTSTANDING,    // 选择在途请求数最少的节点
+        PEAK_EWMA             // 随机选取两个节点，选择 峰值EWMA延迟*(在途请求数+1) 较小的一个
+    };
+
+    // 单个服务的调用选项
+    struct ServiceOptions
+    {
+        LoadBalance lb = LoadBalance::PEAK_EWMA; // 负载均衡策略
+        int timeoutMs = 3000;                    // 单次调用的时间预算(毫秒)，-1表示一直等待
+        int maxRetry = 1;                        // 调用失败时的重试次数
+
+        std::vector<std::string> hedgedMethods;  // 开启请求对冲的接口名称，只能填写幂等的读接口
+        double hedgeRatio = 0.05;                // 对冲请求占总调用量的比例上限
+    };
+
+    class Hedger;
+
+    // 单个节点的信道
+    // 在brpc信道的基础上统计该节点的在途请求数与延迟，供负载均衡策略使用
+    class NodeChannel : public brpc::Channel, public std::enable_shared_from_this<NodeChannel>
+    {
+    public:
+        // 节点的实时负载统计与熔断状态
+        // 统计值只用于挑选节点，更新时不加锁，并发更新偶尔丢失一次采样可以接受
+        //
+        // 熔断：连续失败达到阈值，或者错误率的EWMA超过阈值时，节点被隔离一段冷却时间
+        // 冷却结束后进入半开状态，只放行一个探测请求：探测成功则恢复，失败则冷却时间翻倍后再次隔离
+        struct Stats
+        {
+            static const int64_t DECAY_US = 10 * 1000 * 1000;  // EWMA的衰减时间常数
+            static const int64_t FAILED_US = 1000 * 1000;      // 调用失败时计入的惩罚延迟
+
+            static const int EJECT_FAILURES = 5;                      // 连续失败多少次后隔离
+            static const int64_t EJECT_ERROR_RATE = 5000;             // 错误率(万分比)超过该值后隔离
+            static const int64_t ERROR_RATE_MIN_CALLS = 20;           // 错误率至少积累多少次调用后才参与判断
+            static const int64_t MIN_COOLDOWN_US = 5 * 1000 * 1000;   // 首次隔离的冷却时间
+            static const int64_t MAX_COOLDOWN_US = 60 * 1000 * 1000;  // 冷却时间上限
+
+            std::atomic<int64_t> inflight{0}; // 在途请求数
+            std::atomic<int64_t> ewmaUs{0};   // 峰值敏感的EWMA延迟(微秒)
+            std::atomic<int64_t> stampUs{0};  // EWMA最近一次更新的时间
+
+            std::atomic<int> failures{0};                      // 连续失败次数
+            std::atomic<int64_t> errorRate{0};                 // 错误率的EWMA(万分比)
+            std::atomic<int64_t> calls{0};                     // 上次恢复以来的调用次数
+            std::atomic<int64_t> ejectUntilUs{0};              // 隔离截止时间，0表示节点正常
+            std::atomic<int64_t> cooldownUs{MIN_COOLDOWN_US};  // 下一次隔离的冷却时间
+            std::atomic<int64_t> probeUs{0};                   // 半开状态下探测请求的发出时间
+
+            // 节点是否处于正常状态(未被隔离)
+            bool healthy() const
+            {
+                return ejectUntilUs.load(std::memory_order_relaxed) == 0;
+            }
+
+            // 节点冷却结束后尝试获取探测资格，同一时刻只有一个调用者能够成功
+            // 探测请求若迟迟没有结果(例如被选中后并未真正发出)，超过一个冷却时间后允许重新探测
+            bool tryProbe(int64_t now)
+            {
+                int64_t until = ejectUntilUs.load(std::memory_order_relaxed);
+                if (until == 0 || now < until)
+                    return false;
+
+                int64_t probe = probeUs.load(std::memory_order_relaxed);
+                if (probe != 0 && now - probe < MIN_COOLDOWN_US)
+                    return false;
+                return probeUs.compare_exchange_strong(probe, now);
+            }
+
+            void eject(int64_t now)
+            {
+                int64_t cooldown = cooldownUs.load(std::memory_order_relaxed);
+                ejectUntilUs.store(now + cooldown, std::memory_order_relaxed);
+                cooldownUs.store(cooldown * 2 < MAX_COOLDOWN_US ? cooldown * 2 : MAX_COOLDOWN_US, std::memory_order_relaxed);
+                probeUs.store(0, std::memory_order_relaxed);
+                failures.store(0, std::memory_order_relaxed);
+            }
+
+            void recover()
+            {
+                ejectUntilUs.store(0, std::memory_order_relaxed);
+                cooldownUs.store(MIN_COOLDOWN_US, std::memory_order_relaxed);
+                probeUs.store(0, std::memory_order_relaxed);
+                failures.store(0, std::memory_order_relaxed);
+                errorRate.store(0, std::memory_order_relaxed);
+                calls.store(0, std::memory_order_relaxed);
+            }
+
+            // 更新熔断状态
+            void breaker(int64_t now, bool failed)
+            {
+                int64_t until = ejectUntilUs.load(std::memory_order_relaxed);
+                if (until != 0)
+                {
+                    // 隔离期间结束的旧请求不影响状态，冷却结束后的结果视为探测结果
+                    if (now < until)
+                        return;
+                    if (failed)
+                        eject(now);
+                    else
+                        recover();
+                    return;
+                }
+
+                int64_t rate = errorRate.load(std::memory_order_relaxed);
+                rate += ((failed ? 10000 : 0) - rate) / 16;
+                errorRate.store(rate, std::memory_order_relaxed);
+                int64_t n = calls.fetch_add(1, std::memory_order_relaxed) + 1;
+
+                int consecutive = failed ? failures.fetch_add(1, std::memory_order_relaxed) + 1 : 0;
+                if (!failed)
+                    failures.store(0, std::memory_order_relaxed);
+
+                if (consecutive >= EJECT_FAILURES || (n >= ERROR_RATE_MIN_CALLS && rate > EJECT_ERROR_RATE))
+                {
+                    errorRate.store(0, std::memory_order_relaxed);
+                    calls.store(0, std::memory_order_relaxed);
+                    eject(now);
+                }
+            }
+
+            // neutral: 调用方自行缩短了时间预算且调用因此超时，失败原因不在节点，不计入熔断与延迟统计
+            void finish(int64_t startUs, bool failed, bool neutral = false)
+            {
+                inflight.fetch_sub(1, std::memory_order_relaxed);
+                if (neutral)
+                    return;
+
+                int64_t now = butil::gettimeofday_us();
+                int64_t sample = now - startUs;
+                if (failed && sample < FAILED_US)
+                    sample = FAILED_US;
+                breaker(now, failed);
+
+                // 延迟升高时立即跟上，回落时按时间指数衰减，使变慢的节点能被迅速避开
+                int64_t old = ewmaUs.load(std::memory_order_relaxed);
+                int64_t value = sample;
+                if (sample < old)
+                {
+                    double w = std::exp(-(double)(now - stampUs.load(std::memory_order_relaxed)) / DECAY_US);
+                    value = (int64_t)(old * w + sample * (1 - w));
+                }
+                ewmaUs.store(value, std::memory_order_relaxed);
+                stampUs.store(now, std::memory_order_relaxed);
+            }
+
+            // 负载代价
+            int64_t cost() const
+            {
+                return (ewmaUs.load(std::memory_order_relaxed) + 1) * (inflight.load(std::memory_order_relaxed) + 1);
+            }
+        };
+
+    private:
+        // 异步调用完成时记录统计，再执行调用方的回调
+        class StatsClosure : public google::protobuf::Closure
+        {
+        private:
+            std::shared_ptr<Stats> _stats;
+            int64_t _startUs;
+            bool _shortened;
+            google::protobuf::RpcController *_cntl;
+            google::protobuf::Closure *_done;
+
+        public:
+            StatsClosure(const std::shared_ptr<Stats> &stats, int64_t startUs, bool shortened,
+                         google::protobuf::RpcController *cntl, google::protobuf::Closure *done)
+                : _stats(stats), _startUs(startUs), _shortened(shortened), _cntl(cntl), _done(done) {}
+
+            void Run() override
+            {
+                std::unique_ptr<StatsClosure> self(this);
+                _stats->finish(_startUs, _cntl->Failed(), neutral(_cntl, _shortened));
+                _done->Run();
+            }
+        };
+
+        // 调用方缩短了时间预算后发生的超时不代表节点异常
+        static bool neutral(google::protobuf::RpcController *cntl, bool shortened)
+        {
+            return shortened && static_cast<brpc::Controller *>(cntl)->ErrorCode() == brpc::ERPCTIMEDOUT;
+        }
+
+        std::string _host;            // 节点地址
+        int _weight;                  // 节点权重
+        std::shared_ptr<Stats> _stats; // 节点负载统计(异步回调可能晚于信道释放，因此单独持有)
+        std::shared_ptr<Hedger> _hedger; // 所属服务的请求对冲器，未开启时为空
+
+    public:
+        using ptr = std::shared_ptr<NodeChannel>;
+
+        NodeChannel(const std::string &host, int weight)
+            : _host(host), _weight(weight), _stats(std::make_shared<Stats>())
+        {
+        }
+
+        const std::string &host() const { return _host; }
+        int weight() const { return _weight; }
+        const Stats &stats() const { return *_stats; }
+        Stats &stats() { return *_stats; }
+        void setHedger(const std::shared_ptr<Hedger> &hedger) { _hedger = hedger; }
+
+        // 开启了对冲的接口交给对冲器处理，其余接口直接调用
+        void CallMethod(const google::protobuf::MethodDescriptor *method,
+                        google::protobuf::RpcController *cntl,
+                        const google::protobuf::Message *request,
+                        google::protobuf::Message *response,
+                        google::protobuf::Closure *done) override;
+
+        // 直接调用本节点并记录统计
+        void call(const google::protobuf::MethodDescriptor *method,
+                  google::protobuf::RpcController *cntl,
+                  const google::protobuf::Message *request,
+                  google::protobuf::Message *response,
+                  google::protobuf::Closure *done)
+        {
+            int64_t start = butil::gettimeofday_us();
+            _stats->inflight.fetch_add(1, std::memory_order_relaxed);
+
+            // 调用方设置的时间预算短于信道的时间预算
+            int64_t timeout = static_cast<brpc::Controller *>(cntl)->timeout_ms();
+            bool shortened = timeout >= 0 && (options().timeout_ms < 0 || timeout < options().timeout_ms);
+
+            if (!done)
+            {
+                brpc::Channel::CallMethod(method, cntl, request, response, nullptr);
+                _stats->finish(start, cntl->Failed(), neutral(cntl, shortened));
+                return;
+            }
+
+            brpc::Channel::CallMethod(method, cntl, request, response, new StatsClosure(_stats, start, shortened, cntl, done));
+        }
+    };
+
+    // 请求对冲
+    // 幂等的读接口在主请求超过该接口p95延迟仍未返回时，向另一个节点发送备份请求，先成功返回的结果生效
+    // 落后的请求不会被取消，其结果直接丢弃
+    // 备份请求受全局预算限制：每次调用积累 hedgeRatio 个令牌，每次对冲消耗一个，额外负载不超过该比例
+    // 统计值暴露到brpc的内置监控中：hedge_<服务>_<接口>_hedge 为对冲次数，_hedge_win 为备份请求胜出次数
+    class Hedger
+    {
+    public:
+        using ptr = std::shared_ptr<Hedger>;
+        using Picker = std::function<NodeChannel::ptr(const NodeChannel *exclude)>; // 选择主请求节点以外的节点
+
+    private:
+        static const int64_t TOKEN_UNIT = 1000;           // 一次对冲消耗的令牌数
+        static const int64_t MAX_TOKENS = 10 * 1000;      // 令牌上限，限制突发的对冲数量
+        static const int64_t MIN_SAMPLES = 100;           // 接口至少积累多少次调用后才开始对冲
+        static const int64_t MIN_DELAY_US = 1000;         // 对冲延迟的下限
+        static const int64_t REFRESH_US = 100 * 1000;     // 对冲延迟的刷新间隔
+
+        // 单个接口的对冲统计
+        struct Method
+        {
+            bvar::LatencyRecorder latency;      // 单次请求的延迟(微秒)，用于计算对冲延迟
+            bvar::Adder<int64_t> hedges;        // 发出的备份请求数
+            bvar::Adder<int64_t> wins;          // 备份请求先于主请求成功返回的次数
+            std::atomic<int64_t> delayUs{0};    // 当前的对冲延迟(p95)
+            std::atomic<int64_t> stampUs{0};    // 对冲延迟最近一次刷新的时间
+
+            Method(const std::string &prefix)
+                : latency(prefix), hedges(prefix + "_hedge"), wins(prefix + "_hedge_win") {}
+        };
+
+        // 单次调用的状态，由主请求、备份请求和定时器共同持有
+        struct Call
+        {
+            struct Attempt
+            {
+                NodeChannel::ptr channel;
+                brpc::Controller cntl;
+                std::unique_ptr<google::protobuf::Message> resp;
+                int64_t startUs = 0;
+            };
+
+            Hedger *hedger;
+            Method *stats;
+            const google::protobuf::MethodDescriptor *method;
+            std::unique_ptr<google::protobuf::Message> request; // 请求的副本，备份请求可能晚于调用方释放请求
+            butil::IOBuf attachment;                            // 请求附件的副本
+            uint64_t logId = 0;
+            int64_t timeoutMs = -1;                             // 调用方的时间预算，-1表示一直等待
+            int maxRetry = -1;                                  // 调用方的重试次数，-1表示使用信道的设置
+            // 调用方的控制器与响应：调用方在结果返回后即可释放，只有赢得finished的一方可以访问
+            brpc::Controller *cntl;
+            google::protobuf::Message *response;
+            google::protobuf::Closure *done;
+            bthread::CountdownEvent *event; // 同步调用时等待结果
+
+            std::mutex mutex;
+            Attempt attempts[2]; // 主请求与备份请求
+            int pending = 0;     // 在途的请求数
+            bool finished = false;
+            bthread_timer_t timer;
+            std::shared_ptr<Call> *timerArg = nullptr; // 定时器持有的调用状态，未触发时由删除定时器的一方释放
+        };
+
+        std::unordered_map<std::string, std::unique_ptr<Method>> _methods; // 开启对冲的接口(只在构造时写入)
+        int64_t _tokenPerCall;                 // 每次调用积累的令牌数
+        std::atomic<int64_t> _tokens;          // 剩余令牌数
+        bvar::Adder<int64_t> _exhausted;       // 因预算耗尽而放弃的对冲次数
+        Picker _picker;
+
+    private:
+        void deposit()
+        {
+            int64_t tokens = _tokens.load(std::memory_order_relaxed);
+            while (tokens < MAX_TOKENS)
+            {
+                int64_t value = tokens + _tokenPerCall < MAX_TOKENS ? tokens + _tokenPerCall : MAX_TOKENS;
+                if (_tokens.compare_exchange_weak(tokens, value, std::memory_order_relaxed))
+                    return;
+            }
+        }
+
+        bool withdraw()
+        {
+            int64_t tokens = _tokens.load(std::memory_order_relaxed);
+            while (tokens >= TOKEN_UNIT)
+            {
+                if (_tokens.compare_exchange_weak(tokens, tokens - TOKEN_UNIT, std::memory_order_relaxed))
+                    return true;
+            }
+            return false;
+        }
+
+        // 对冲延迟取接口的p95延迟，分位值的计算较重，按间隔刷新
+        int64_t delay(Method *m)
+        {
+            if (m->latency.count() < MIN_SAMPLES)
+                return 0;
+
+            int64_t now = butil::gettimeofday_us();
+            if (now - m->stampUs.load(std::memory_order_relaxed) > REFRESH_US)
+            {
+                int64_t p95 = m->latency.latency_percentile(0.95);
+                m->delayUs.store(p95 > MIN_DELAY_US ? p95 : MIN_DELAY_US, std::memory_order_relaxed);
+                m->stampUs.store(now, std::memory_order_relaxed);
+            }
+            return m->delayUs.load(std::memory_order_relaxed);
+        }
+
+        // 发出一次请求，只读取调用状态中自有的数据(响应对象在调用开始时已分配)
+        static void launch(const std::shared_ptr<Call> &call, int i)
+        {
+            Call::Attempt &a = call->attempts[i];
+            a.cntl.request_attachment() = call->attachment;
+            a.cntl.set_log_id(call->logId);
+            if (call->maxRetry >= 0)
+                a.cntl.set_max_retry(call->maxRetry);
+            if (call->timeoutMs >= 0)
+            {
+                // 主请求使用完整的时间预算，备份请求只使用剩余的时间
+                int64_t remain = i == 0 ? call->timeoutMs
+                                        : call->timeoutMs - (butil::gettimeofday_us() - call->attempts[0].startUs) / 1000;
+                a.cntl.set_timeout_ms(remain > 1 ? remain : 1);
+            }
+            a.startUs = butil::gettimeofday_us();
+            a.channel->call(call->method, &a.cntl, call->request.get(), a.resp.get(), brpc::NewCallback(&Hedger::onDone, call, i));
+        }
+
+        static void onDone(std::shared_ptr<Call> call, int i)
+        {
+            Call::Attempt &a = call->attempts[i];
+            if (!a.cntl.Failed())
+                call->stats->latency << butil::gettimeofday_us() - a.startUs;
+
+            {
+                std::unique_lock<std::mutex> lock(call->mutex);
+                --call->pending;
+                // 失败时若另一个请求仍在途，等待它的结果
+                if (call->finished || (a.cntl.Failed() && call->pending > 0))
+                    return;
+                call->finished = true;
+            }
+
+            if (call->timerArg && bthread_timer_del(call->timer) == 0)
+                delete call->timerArg;
+
+            if (a.cntl.Failed())
+            {
+                call->cntl->SetFailed(a.cntl.ErrorCode(), "%s", a.cntl.ErrorText().c_str());
+            }
+            else
+            {
+                call->response->GetReflection()->Swap(call->response, a.resp.get());
+                call->cntl->response_attachment().swap(a.cntl.response_attachment());
+                if (i == 1)
+                    call->stats->wins << 1;
+            }
+
+            if (call->done)
+                call->done->Run();
+            else
+                call->event->signal();
+        }
+
+        static void onTimer(void *arg)
+        {
+            std::unique_ptr<std::shared_ptr<Call>> holder(static_cast<std::shared_ptr<Call> *>(arg));
+            (*holder)->hedger->hedge(*holder);
+        }
+
+        // 主请求超时未返回，向另一个节点发送备份请求
+        void hedge(const std::shared_ptr<Call> &call)
+        {
+            {
+                std::unique_lock<std::mutex> lock(call->mutex);
+                if (call->finished)
+                    return;
+            }
+
+            auto backup = _picker(call->attempts[0].channel.get());
+            if (!backup)
+                return;
+            if (!withdraw())
+            {
+                _exhausted << 1;
+                return;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(call->mutex);
+                if (call->finished)
+                    return;
+                call->attempts[1].channel = backup;
+                ++call->pending;
+            }
+            call->stats->hedges << 1;
+            launch(call, 1);
+        }
+
+    public:
+        // name: 服务名称  methods: 开启对冲的接口名称  ratio: 对冲请求占总调用量的比例上限
+        Hedger(const std::string &name, const std::vector<std::string> &methods, double ratio, const Picker &picker)
+            : _tokenPerCall((int64_t)(ratio * TOKEN_UNIT)),
+              _tokens(0),
+              _picker(picker)
+        {
+            std::string prefix = "hedge" + name;
+            std::replace(prefix.begin(), prefix.end(), '/', '_');
+            for (auto &method : methods)
+                _methods[method].reset(new Method(prefix + "_" + method));
+            _exhausted.expose(prefix + "_hedge_exhausted");
+        }
+
+        void call(const NodeChannel::ptr &primary,
+                  const google::protobuf::MethodDescriptor *method,
+                  google::protobuf::RpcController *controller,
+                  const google::protobuf::Message *request,
+                  google::protobuf::Message *response,
+                  google::protobuf::Closure *done)
+        {
+            auto it = _methods.find(method->name());
+            if (it == _methods.end())
+                return primary->call(method, controller, request, response, done);
+            deposit();
+
+            bthread::CountdownEvent event(1);
+            auto state = std::make_shared<Call>();
+            state->hedger = this;
+            state->stats = it->second.get();
+            state->method = method;
+            state->request.reset(request->New());
+            state->request->CopyFrom(*request);
+            state->cntl = static_cast<brpc::Controller *>(controller);
+            state->response = response;
+            // 备份请求需要的数据在此复制，主请求返回后调用方的控制器与响应随时可能被释放
+            state->attachment = state->cntl->request_attachment();
+            state->logId = state->cntl->log_id();
+            // 调用方未设置时控制器返回负值，此时使用信道的设置
+            state->timeoutMs = state->cntl->timeout_ms() >= 0 ? state->cntl->timeout_ms() : primary->options().timeout_ms;
+            state->maxRetry = state->cntl->max_retry() >= 0 ? state->cntl->max_retry() : -1;
+            state->attempts[0].resp.reset(response->New());
+            state->attempts[1].resp.reset(response->New());
+            state->done = done;
+            state->event = &event;
+            state->attempts[0].channel = primary;
+            state->attempts[0].startUs = butil::gettimeofday_us();
+            state->pending = 1;
+
+            int64_t delayUs = delay(state->stats);
+            if (delayUs > 0)
+            {
+                state->timerArg = new std::shared_ptr<Call>(state);
+                if (bthread_timer_add(&state->timer, butil::microseconds_from_now(delayUs), &Hedger::onTimer, state->timerArg) != 0)
+                {
+                    delete state->timerArg;
+                    state->timerArg = nullptr;
+                }
+            }
+            launch(state, 0);
+
+            if (!done)
+                event.wait();
+        }
+    };
+
+    inline void NodeChannel::CallMethod(const google::protobuf::MethodDescriptor *method,
+                                        google::protobuf::RpcController *cntl,
+                                        const google::protobuf::Message *request,
+                                        google::protobuf::Message *response,
+                                        google::protobuf::Closure *done)
+    {
+        if (_hedger)
+            _hedger->call(shared_from_this(), method, cntl, request, response, done);
+        else
+            call(method, cntl, request, response, done);
+    }
+
     // 单个服务的信道管理类
+    // 节点列表使用双缓冲保存：上下线时修改后台副本再切换，读取时只加本线程私有的锁，读线程之间互不竞争
     class ServiceChannel
     {
     public:
@@ -16,86 +545,360 @@ namespace hjb
         using ChannelPtr = std::shared_ptr<brpc::Channel>;
 
     private:
-        std::string _name;                                  // 服务名称
-        std::vector<ChannelPtr> _channels;                  // 当前服务对应的所有信道
-        std::unordered_map<std::string, ChannelPtr> _hosts; // 主机ip与信道的映射
-        int32_t _index;                                     // 当前信道轮转下标计数器
-        std::mutex _mutex;
+        static const int MAX_WEIGHT = 100;   // 节点权重上限
+        static const int VIRTUAL_NODES = 40; // 一致性哈希中每单位权重对应的虚拟节点数
+
+        // 服务的节点列表
+        struct Nodes
+        {
+            std::vector<NodeChannel::ptr> channels;                  // 当前服务对应的所有信道
+            std::unordered_map<std::string, NodeChannel::ptr> hosts; // 主机ip与信道的映射
+            std::vector<uint32_t> schedule;                          // 加权轮转的调度序列(信道下标)
+            std::vector<std::pair<uint32_t, uint32_t>> ring;         // 一致性哈希环(虚拟节点哈希值, 信道下标)，按哈希值有序
+        };
+
+        std::string _name;                       // 服务名称
+        ServiceOptions _options;                 // 调用选项
+        Hedger::ptr _hedger;                     // 请求对冲器，未开启对冲时为空
+        butil::DoublyBufferedData<Nodes> _nodes; // 节点列表
+        std::atomic<uint32_t> _index;            // 信道轮转计数器(无符号，溢出后自然回绕)
+
+    private:
+        // 解析服务注册中心中的节点信息
+        // 格式为 ip:port，可以附带参数 ip:port;weight=N
+        static void parse(const std::string &value, std::string &host, int &weight)
+        {
+            weight = 1;
+            auto pos = value.find(';');
+            host = value.substr(0, pos);
+            if (pos == std::string::npos)
+                return;
+
+            auto wpos = value.find("weight=", pos);
+            if (wpos == std::string::npos)
+                return;
+
+            weight = atoi(value.c_str() + wpos + 7);
+            if (weight < 1)
+                weight = 1;
+            if (weight > MAX_WEIGHT)
+                weight = MAX_WEIGHT;
+        }
+
+        // 按平滑加权轮转算法预先生成一轮完整的调度序列，读取时只需要原子递增下标
+        static void buildSchedule(Nodes &nodes)
+        {
+            nodes.schedule.clear();
+            int total = 0;
+            for (auto &c : nodes.channels)
+                total += c->weight();
+
+            std::vector<int> current(nodes.channels.size(), 0);
+            for (int n = 0; n < total; ++n)
+            {
+                size_t best = 0;
+                for (size_t i = 0; i < nodes.channels.size(); ++i)
+                {
+                    current[i] += nodes.channels[i]->weight();
+                    if (current[i] > current[best])
+                        best = i;
+                }
+                current[best] -= total;
+                nodes.schedule.push_back(best);
+            }
+        }
+
+        // 稳定的字符串哈希(FNV-1a + murmur3的末尾混合)，不同进程、不同机器上结果一致
+        static uint32_t hash(const std::string &key)
+        {
+            uint32_t h = 2166136261u;
+            for (unsigned char c : key)
+            {
+                h ^= c;
+                h *= 16777619u;
+            }
+            h ^= h >> 16;
+            h *= 0x85ebca6bu;
+            h ^= h >> 13;
+            h *= 0xc2b2ae35u;
+            h ^= h >> 16;
+            return h;
+        }
+
+        // 生成一致性哈希环
+        // 虚拟节点的位置只由节点地址决定，节点上下线时只有落在该节点上的键会迁移
+        static void buildRing(Nodes &nodes)
+        {
+            nodes.ring.clear();
+            for (uint32_t i = 0; i < nodes.channels.size(); ++i)
+            {
+                int count = VIRTUAL_NODES * nodes.channels[i]->weight();
+                for (int v = 0; v < count; ++v)
+                    nodes.ring.emplace_back(hash(nodes.channels[i]->host() + "#" + std::to_string(v)), i);
+            }
+            std::sort(nodes.ring.begin(), nodes.ring.end());
+        }
+
+        static size_t addNode(Nodes &nodes, const std::string &host, const NodeChannel::ptr &channel)
+        {
+            if (!nodes.hosts.insert(std::make_pair(host, channel)).second)
+                return 0;
+
+            nodes.channels.push_back(channel);
+            buildSchedule(nodes);
+            buildRing(nodes);
+            return 1;
+        }
+
+        static size_t removeNode(Nodes &nodes, const std::string &host)
+        {
+            auto it = nodes.hosts.find(host);
+            if (it == nodes.hosts.end())
+                return 0;
+
+            for (auto i = nodes.channels.begin(); i != nodes.channels.end(); ++i)
+            {
+                if (*i == it->second)
+                {
+                    nodes.channels.erase(i);
+                    break;
+                }
+            }
+
+            nodes.hosts.erase(it);
+            buildSchedule(nodes);
+            buildRing(nodes);
+            return 1;
+        }
+
+        // 节点是否可以参与选择，all为true时忽略熔断状态
+        static bool usable(const NodeChannel::ptr &channel, bool all)
+        {
+            return all || channel->stats().healthy();
+        }
+
+        // 从start开始顺序查找第一个可以参与选择的节点
+        static NodeChannel::ptr next(const Nodes &nodes, size_t start, bool all)
+        {
+            size_t n = nodes.channels.size();
+            for (size_t k = 0; k < n; ++k)
+            {
+                const auto &channel = nodes.channels[(start + k) % n];
+                if (usable(channel, all))
+                    return channel;
+            }
+            return NodeChannel::ptr();
+        }
+
+        // 选择在途请求数最少的节点，从轮转位置开始扫描以打散并列的节点
+        NodeChannel::ptr leastOutstanding(const Nodes &nodes, bool all)
+        {
+            size_t n = nodes.channels.size();
+            size_t start = _index.fetch_add(1, std::memory_order_relaxed) % n;
+            NodeChannel::ptr best;
+            int64_t min = 0;
+            for (size_t k = 0; k < n; ++k)
+            {
+                const auto &channel = nodes.channels[(start + k) % n];
+                if (!usable(channel, all))
+                    continue;
+
+                int64_t cur = channel->stats().inflight.load(std::memory_order_relaxed);
+                if (!best || cur < min)
+                {
+                    min = cur;
+                    best = channel;
+                    if (min == 0)
+                        break;
+                }
+            }
+            return best;
+        }
+
+        // 两次随机选择：只比较两个随机节点，避免所有调用方同时涌向同一个"最优"节点
+        NodeChannel::ptr peakEwma(const Nodes &nodes, bool all)
+        {
+            size_t n = nodes.channels.size();
+            if (n == 1)
+                return usable(nodes.channels[0], all) ? nodes.channels[0] : NodeChannel::ptr();
+
+            size_t a = butil::fast_rand_less_than(n);
+            size_t b = butil::fast_rand_less_than(n - 1);
+            if (b >= a)
+                ++b;
+
+            const auto &ca = nodes.channels[a];
+            const auto &cb = nodes.channels[b];
+            bool okA = usable(ca, all), okB = usable(cb, all);
+            if (okA && okB)
+                return ca->stats().cost() <= cb->stats().cost() ? ca : cb;
+            if (okA)
+                return ca;
+            if (okB)
+                return cb;
+
+            // 两个随机节点都被隔离，退化为顺序查找
+            return next(nodes, a, all);
+        }
+
+        // 按负载均衡策略选择节点
+        NodeChannel::ptr select(const Nodes &nodes, bool all)
+        {
+            switch (_options.lb)
+            {
+            case LoadBalance::WEIGHTED_ROUND_ROBIN:
+            {
+                uint32_t idx = _index.fetch_add(1, std::memory_order_relaxed);
+                return next(nodes, nodes.schedule[idx % nodes.schedule.size()], all);
+            }
+            case LoadBalance::LEAST_OUTSTANDING:
+                return leastOutstanding(nodes, all);
+            case LoadBalance::PEAK_EWMA:
+                return peakEwma(nodes, all);
+            default:
+            {
+                uint32_t idx = _index.fetch_add(1, std::memory_order_relaxed);
+                return next(nodes, idx % nodes.channels.size(), all);
+            }
+            }
+        }
 
     public:
-        ServiceChannel(const std::string &name)
-            : _name(name), _index(0)
+        ServiceChannel(const std::string &name, const ServiceOptions &options = ServiceOptions())
+            : _name(name), _options(options), _index(0)
         {
+            // 服务信道由 AllServiceChannel 持有直到进程退出，对冲器可以直接引用本对象
+            if (!_options.hedgedMethods.empty())
+                _hedger = std::make_shared<Hedger>(name, _options.hedgedMethods, _options.hedgeRatio,
+                                                   [this](const NodeChannel *exclude)
+                                                   { return other(exclude); });
         }
 
         // 服务器上线，添加信道
-        void append(const std::string &host)
+        void append(const std::string &value)
         {
+            std::string host;
+            int weight;
+            parse(value, host, weight);
+
             // 创建信道并初始化
-            auto channel = std::make_shared<brpc::Channel>();
+            auto channel = std::make_shared<NodeChannel>(host, weight);
             brpc::ChannelOptions options;
-            options.protocol = "baidu_std"; // 序列化协议
-            options.timeout_ms = -1;        // 一直等待rpc请求
-            options.max_retry = 3;          // 请求重试3次
+            options.protocol = "baidu_std";             // 序列化协议
+            options.timeout_ms = _options.timeoutMs;    // 单次调用的时间预算，避免卡死的节点拖住调用方
+            options.max_retry = _options.maxRetry;      // 重试次数保持较少，避免故障时放大负载
             if (channel->Init(host.c_str(), &options) != 0)
             {
                 ERROR("初始化{}-{}节点信道出错", _name, host);
                 return;
             }
 
-            std::unique_lock<std::mutex> lock(_mutex);
-            _hosts.insert(std::make_pair(host, channel));
-            _channels.push_back(channel);
+            channel->setHedger(_hedger);
+            if (_nodes.Modify(addNode, host, channel) == 0)
+                WARN("{}-{}节点重复上线", _name, host);
         }
 
         // 服务器下线，删除信道
-        void remove(const std::string &host)
+        void remove(const std::string &value)
         {
-            std::unique_lock<std::mutex> lock(_mutex);
-            auto it = _hosts.find(host);
-            if (it == _hosts.end())
-            {
+            std::string host;
+            int weight;
+            parse(value, host, weight);
+
+            if (_nodes.Modify(removeNode, host) == 0)
                 WARN("{}-{}节点删除信道操作，无法找到该主机", _name, host);
-                return;
+        }
+
+        // 随机选择一个排除指定节点以外的正常节点，供请求对冲发送备份请求
+        NodeChannel::ptr other(const NodeChannel *exclude)
+        {
+            butil::DoublyBufferedData<Nodes>::ScopedPtr nodes;
+            if (_nodes.Read(&nodes) != 0 || nodes->channels.size() < 2)
+                return NodeChannel::ptr();
+
+            size_t n = nodes->channels.size();
+            size_t start = butil::fast_rand_less_than(n);
+            for (size_t k = 0; k < n; ++k)
+            {
+                const auto &channel = nodes->channels[(start + k) % n];
+                if (channel.get() != exclude && channel->stats().healthy())
+                    return channel;
             }
+            return NodeChannel::ptr();
+        }
 
-            for (auto i = _channels.begin(); i != _channels.end(); ++i)
+        // 按负载均衡策略获取信道
+        // 被隔离的节点不参与选择，冷却结束的节点优先获得一次探测机会
+        // 所有节点都被隔离时忽略熔断状态，避免服务因误判而完全不可用
+        ChannelPtr get()
+        {
+            butil::DoublyBufferedData<Nodes>::ScopedPtr nodes;
+            if (_nodes.Read(&nodes) != 0 || nodes->channels.empty())
             {
-                if (*i == it->second)
-                {
-                    _channels.erase(i);
-                    break;
-                }
+                ERROR("找不到提供 {} 服务的节点！", _name);
+                return ChannelPtr();
             }
 
-            _hosts.erase(it);
+            int64_t now = butil::gettimeofday_us();
+            for (const auto &channel : nodes->channels)
+            {
+                if (channel->stats().tryProbe(now))
+                    return channel;
+            }
+
+            NodeChannel::ptr channel = select(*nodes, false);
+            if (!channel)
+            {
+                WARN("{} 服务的所有节点均已熔断", _name);
+                channel = select(*nodes, true);
+            }
+            return channel;
         }
 
-        // 获取信道(RR轮转)
-        ChannelPtr get()
+        // 按键的一致性哈希获取信道，相同的键总是落到同一个节点上
+        // 键对应的节点被隔离时沿哈希环顺时针转移到下一个正常节点
+        ChannelPtr get(const std::string &key)
         {
-            std::unique_lock<std::mutex> lock(_mutex);
-            if (_channels.size() == 0)
+            butil::DoublyBufferedData<Nodes>::ScopedPtr nodes;
+            if (_nodes.Read(&nodes) != 0 || nodes->ring.empty())
             {
                 ERROR("找不到提供 {} 服务的节点！", _name);
                 return ChannelPtr();
             }
 
-            int32_t idx = _index++ % _channels.size();
-            return _channels[idx];
+            int64_t now = butil::gettimeofday_us();
+            auto begin = std::lower_bound(nodes->ring.begin(), nodes->ring.end(), std::make_pair(hash(key), (uint32_t)0));
+            if (begin == nodes->ring.end())
+                begin = nodes->ring.begin();
+
+            auto it = begin;
+            do
+            {
+                auto &channel = nodes->channels[it->second];
+                if (channel->stats().healthy() || channel->stats().tryProbe(now))
+                    return channel;
+                if (++it == nodes->ring.end())
+                    it = nodes->ring.begin();
+            } while (it != begin);
+
+            WARN("{} 服务的所有节点均已熔断", _name);
+            return nodes->channels[begin->second];
         }
     };
 
     // 全部服务的信道管理类
+    // 服务表同样使用双缓冲保存，choose 不再持有任何全局锁
     class AllServiceChannel
     {
     public:
         using ptr = std::shared_ptr<AllServiceChannel>;
 
     private:
-        std::mutex _mutex;
-        std::unordered_set<std::string> _followServices;                // 需要关心上下线的服务集合
-        std::unordered_map<std::string, ServiceChannel::ptr> _services; // 所有服务和主机的集合
+        using ServiceMap = std::unordered_map<std::string, ServiceChannel::ptr>;
+
+        std::mutex _mutex;                                // 保护关注列表以及服务表的创建(只在写路径上使用)
+        std::unordered_map<std::string, ServiceOptions> _followServices; // 需要关心上下线的服务及其调用选项
+        butil::DoublyBufferedData<ServiceMap> _services;  // 所有服务和主机的集合
 
     private:
         // 获取服务节点的名称
@@ -108,6 +911,25 @@ namespace hjb
             return instance.substr(0, pos);
         }
 
+        static size_t addService(ServiceMap &services, const std::string &name, const ServiceChannel::ptr &service)
+        {
+            return services.insert(std::make_pair(name, service)).second ? 1 : 0;
+        }
+
+        // 查找服务管理对象
+        ServiceChannel::ptr find(const std::string &name)
+        {
+            butil::DoublyBufferedData<ServiceMap>::ScopedPtr services;
+            if (_services.Read(&services) != 0)
+                return ServiceChannel::ptr();
+
+            auto it = services->find(name);
+            if (it == services->end())
+                return ServiceChannel::ptr();
+
+            return it->second;
+        }
+
     public:
         AllServiceChannel()
         {
@@ -116,24 +938,37 @@ namespace hjb
         // 获取指定服务的节点信道
         ServiceChannel::ChannelPtr choose(const std::string &name)
         {
-            std::unique_lock<std::mutex> lock(_mutex);
-            
-            auto it = _services.find(name);
-            if (it == _services.end())
+            auto service = find(name);
+            if (!service)
+            {
+                ERROR("找不到提供 {} 服务的节点！", name);
+                return ServiceChannel::ChannelPtr();
+            }
+
+            return service->get();
+        }
+
+        // 按键获取指定服务的节点信道(一致性哈希)
+        // 同一聊天会话或同一用户的请求固定落到同一节点，便于子服务在本地缓存热点数据
+        ServiceChannel::ChannelPtr choose(const std::string &name, const std::string &key)
+        {
+            auto service = find(name);
+            if (!service)
             {
                 ERROR("找不到提供 {} 服务的节点！", name);
                 return ServiceChannel::ChannelPtr();
             }
 
-            return it->second->get();
+            return service->get(key);
         }
 
         // 声明关注哪些服务的上下线 不关心的就不需要管理
-        void declared(const std::string &name)
+        // options: 该服务的负载均衡策略与调用时间预算
+        void declared(const std::string &name, const ServiceOptions &options = ServiceOptions())
         {
             std::unique_lock<std::mutex> lock(_mutex);
 
-            _followServices.insert(name);
+            _followServices[name] = options;
         }
 
         // 服务上线时调用的回调接口
@@ -153,15 +988,11 @@ namespace hjb
                 }
 
                 // 先获取管理对象，没有则创建，有则添加节点
-                auto it = _services.find(name);
-                if (it == _services.end())
-                {
-                    service = std::make_shared<ServiceChannel>(name);
-                    _services.insert(std::make_pair(name, service));
-                }
-                else
+                service = find(name);
+                if (!service)
                 {
-                    service = it->second;
+                    service = std::make_shared<ServiceChannel>(name, fit->second);
+                    _services.Modify(addService, name, service);
                 }
             }
 
@@ -191,13 +1022,12 @@ namespace hjb
                     return;
                 }
 
-                auto it = _services.find(name);
-                if (it == _services.end())
+                service = find(name);
+                if (!service)
                 {
                     WARN("删除{}服务节点时，没有找到管理对象", name);
                     return;
                 }
-                service = it->second;
             }
 
             service->remove(host);
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <brpc/channel.h>
+
+#include "log.hpp"
+#include "sha256.hpp"
+#include "file.pb.h"
+
+namespace hjb
+{
+    // 子服务向文件服务上传一份文件数据，成功时返回true并填入文件id
+    // 数据不小于 HASH_PROBE_BYTES 时先按SHA-256摘要秒传，文件服务已有相同内容时不再传输数据；小文件直接上传，省去一次往返
+    // 上传不是幂等操作，调用不重试；body在上传时被移入请求，调用后内容不确定
+    //
+    // 代表用户上传的文件，文件服务生成的文件id以上传者标记 "_<用户id摘要的前16位>" 结尾
+    // 子服务据此确认客户端在消息中引用的文件id由其本人上传，不需要额外调用文件服务
+    class FileUploader
+    {
+    public:
+        static const size_t HASH_PROBE_BYTES = 64 * 1024; // 先尝试秒传的最小文件大小
+
+        // 文件id的上传者标记，userId为空(子服务自行上传)时没有标记
+        static std::string ownerSuffix(const std::string &userId)
+        {
+            if (userId.empty())
+                return "";
+            return "_" + Sha256::of(userId).substr(0, 16);
+        }
+
+        // 文件是否由该用户上传
+        // 只用于发送消息时拒绝引用他人上传的文件id，并不限制下载：消息中的文件需要由会话的其他成员下载，
+        // 文件服务与网关的下载接口对任何已登录用户开放，不应依赖此检查做访问控制
+        static bool ownedBy(const std::string &fileId, const std::string &userId)
+        {
+            std::string suffix = ownerSuffix(userId);
+            return !suffix.empty() && fileId.size() > suffix.size() &&
+                   fileId.compare(fileId.size() - suffix.size(), suffix.size(), suffix) == 0;
+        }
+
+        // userId: 代为上传的用户，文件id带有该用户的上传者标记
+        static bool put(brpc::Channel *channel,
+                        const std::string &rid,
+                        const std::string &userId,
+                        const std::string &fileName,
+                        std::string *body,
+                        std::string &fileId)
+        {
+            FileService_Stub stub(channel);
+
+            if (body->size() >= HASH_PROBE_BYTES)
+            {
+                PutFileByHashReq req;
+                PutFileByHashResp resp;
+                req.set_requestid(rid);
+                req.set_userid(userId);
+                req.set_sha256(Sha256::of(*body));
+                req.set_filename(fileName);
+                req.set_filesize(body->size());
+
+                brpc::Controller cntl;
+                cntl.set_max_retry(0);
+                stub.PutFileByHash(&cntl, &req, &resp, nullptr);
+                if (!cntl.Failed() && resp.success() && resp.exists())
+                {
+                    fileId = resp.fileinfo().fileid();
+                    return true;
+                }
+                // 秒传失败不影响上传，照常传输数据
+            }
+
+            PutSingleFileReq req;
+            PutSingleFileResp resp;
+            req.set_requestid(rid);
+            req.set_userid(userId);
+            req.mutable_filedata()->set_filename(fileName);
+            req.mutable_filedata()->set_filesize(body->size());
+            req.mutable_filedata()->mutable_filecontent()->swap(*body);
+
+            brpc::Controller cntl;
+            cntl.set_max_retry(0);
+            stub.PutSingleFile(&cntl, &req, &resp, nullptr);
+            if (cntl.Failed() || !resp.success())
+            {
+                ERROR("{} - 文件子服务调用失败：{}", rid, cntl.Failed() ? cntl.ErrorText() : resp.errmsg());
+                return false;
+            }
+
+            fileId = resp.fileinfo().fileid();
+            return true;
+        }
+    };
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+namespace hjb
+{
+    // 分片的LRU本地缓存，每个条目带有过期时间
+    // 键按哈希分散到多个分片，每个分片独立加锁，分片内部按最近访问顺序淘汰
+    template <typename K, typename V>
+    class LruCache
+    {
+    public:
+        using ptr = std::shared_ptr<LruCache<K, V>>;
+        using Clock = std::chrono::steady_clock;
+
+    private:
+        struct Entry
+        {
+            K key;
+            V value;
+            Clock::time_point expire; // 过期时间点
+        };
+
+        struct Shard
+        {
+            std::mutex mutex;
+            std::list<Entry> entries; // 表头为最近访问的条目
+            std::unordered_map<K, typename std::list<Entry>::iterator> index;
+        };
+
+        size_t _capacity;               // 每个分片的容量
+        Clock::duration _ttl;           // 条目的存活时长
+        std::vector<Shard> _shards;
+
+        Shard &shard(const K &key)
+        {
+            return _shards[std::hash<K>()(key) % _shards.size()];
+        }
+
+    public:
+        // capacity: 缓存的总容量  ttl: 条目的存活时长  shards: 分片数量
+        LruCache(size_t capacity, Clock::duration ttl, size_t shards = 16)
+            : _capacity(1),
+              _ttl(ttl),
+              _shards(shards > 0 ? shards : 1)
+        {
+            if (capacity / _shards.size() > 0)
+                _capacity = capacity / _shards.size();
+        }
+
+        // 查找条目，命中时刷新其访问顺序，过期的条目视为未命中并直接删除
+        bool get(const K &key, V &value)
+        {
+            Shard &s = shard(key);
+            std::unique_lock<std::mutex> lock(s.mutex);
+
+            auto it = s.index.find(key);
+            if (it == s.index.end())
+                return false;
+
+            if (it->second->expire <= Clock::now())
+            {
+                s.entries.erase(it->second);
+                s.index.erase(it);
+                return false;
+            }
+
+            s.entries.splice(s.entries.begin(), s.entries, it->second);
+            value = it->second->value;
+            return true;
+        }
+
+        // 新增或更新条目，分片已满时淘汰最久未访问的条目
+        void put(const K &key, const V &value)
+        {
+            put(key, value, _ttl);
+        }
+
+        // 指定条目的存活时长，不超过缓存统一的存活时长(例如数据源中的条目本身会更早过期)
+        void put(const K &key, const V &value, Clock::duration ttl)
+        {
+            if (ttl > _ttl)
+                ttl = _ttl;
+
+            Shard &s = shard(key);
+            std::unique_lock<std::mutex> lock(s.mutex);
+
+            auto it = s.index.find(key);
+            if (it != s.index.end())
+            {
+                it->second->value = value;
+                it->second->expire = Clock::now() + ttl;
+                s.entries.splice(s.entries.begin(), s.entries, it->second);
+                return;
+            }
+
+            if (s.entries.size() >= _capacity)
+            {
+                s.index.erase(s.entries.back().key);
+                s.entries.pop_back();
+            }
+
+            s.entries.push_front(Entry{key, value, Clock::now() + ttl});
+            s.index[key] = s.entries.begin();
+        }
+
+        void erase(const K &key)
+        {
+            Shard &s = shard(key);
+            std::unique_lock<std::mutex> lock(s.mutex);
+
+            auto it = s.index.find(key);
+            if (it == s.index.end())
+                return;
+
+            s.entries.erase(it->second);
+            s.index.erase(it);
+        }
+
+        void clear()
+        {
+            for (auto &s : _shards)
+            {
+                std::unique_lock<std::mutex> lock(s.mutex);
+                s.entries.clear();
+                s.index.clear();
+            }
+        }
+    };
+}
\ No newline at end of file
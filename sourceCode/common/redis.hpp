@@ -3,7 +3,12 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
 #include <sw/redis++/redis.h>
+#include "lruCache.hpp"
+#include "log.hpp"
 
 // redisClient工厂(构造redis操作对象)
 class RedisClientFactory
@@ -12,75 +17,183 @@ public:
     static std::shared_ptr<sw::redis::Redis> create(const std::string &host,
                                    int port,
                                    int db,
-                                   bool keepAlive)
+                                   bool keepAlive,
+                                   int poolSize = 1)
     {
         sw::redis::ConnectionOptions opts;
         opts.host = host;              // ip
         opts.port = port;              // 端口
         opts.db = db;                  // 库的编号
         opts.keep_alive = keepAlive;   // 是否长连接保活
-        auto client = std::make_shared<sw::redis::Redis>(opts); // 实例化对象
+        sw::redis::ConnectionPoolOptions poolOpts;
+        poolOpts.size = poolSize;      // 连接池大小(多线程并发访问时使用)
+        auto client = std::make_shared<sw::redis::Redis>(opts, poolOpts); // 实例化对象
 
         return client;
     }
 };
 
+// 缓存失效通知的订阅(在调用线程中持续运行，通常放在单独的线程中)
+// channel: 通知频道  erase: 收到通知时失效对应条目  clear: 清空整个缓存
+// 订阅连接断开期间可能错过通知，因此每次(重新)订阅时清空整个缓存
+inline void subscribeInvalidation(const std::shared_ptr<sw::redis::Redis> &client,
+                                  const std::string &channel,
+                                  const std::function<void(const std::string &)> &erase,
+                                  const std::function<void()> &clear)
+{
+    while (true)
+    {
+        try
+        {
+            auto sub = client->subscriber();
+            sub.on_message([erase](std::string, std::string key)
+                           { erase(key); });
+            sub.subscribe(channel);
+            clear();
+
+            while (true)
+            {
+                try
+                {
+                    sub.consume();
+                }
+                catch (const sw::redis::TimeoutError &e)
+                {
+                    continue;
+                }
+            }
+        }
+        catch (const sw::redis::Error &e)
+        {
+            ERROR("{} 失效通知订阅异常：{}", channel, e.what());
+            clear();
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    }
+}
+
+// 批量操作说明
+// 各操作类的写操作都提供接收批量对象(sw::redis::Pipeline 或 sw::redis::Transaction)的重载
+// 调用方通过 redis->pipeline(false) 或 redis->transaction(true, false) 创建批量对象，
+// 可以把多个操作类的命令装入同一个批量对象，最后调用 exec() 一次网络往返全部发送
+
 // 用户登录会话类
+// 可选开启本地缓存：命中缓存的鉴权请求不再访问redis
+// 会话删除时通过redis发布订阅通知所有持有缓存的实例失效对应条目，缓存的过期时间作为兜底
 class LoginSession
 {
 private:
     std::shared_ptr<sw::redis::Redis> _client;
+    hjb::LruCache<std::string, std::string>::ptr _cache; // 登录会话id与用户id的本地缓存(未开启时为空)
+    std::shared_ptr<std::atomic<uint64_t>> _epoch;       // 每次失效时递增，查询期间发生过失效的结果不写入缓存
 
 public:
     using ptr = std::shared_ptr<LoginSession>;
 
     LoginSession(const std::shared_ptr<sw::redis::Redis> &client) : _client(client) {}
 
-    void append(const std::string &sid, const std::string &uid)
+    // 开启本地缓存
+    // capacity: 缓存的会话数量上限  ttl: 缓存条目的存活时长
+    LoginSession(const std::shared_ptr<sw::redis::Redis> &client,
+                 size_t capacity,
+                 const std::chrono::seconds &ttl)
+        : _client(client),
+          _cache(std::make_shared<hjb::LruCache<std::string, std::string>>(capacity, ttl)),
+          _epoch(std::make_shared<std::atomic<uint64_t>>(0))
     {
-        _client->set(sid, uid);
+        // 订阅会话失效通知
+        auto cache = _cache;
+        auto epoch = _epoch;
+        std::thread(subscribeInvalidation, _client, invalidateChannel(),
+                    [cache, epoch](const std::string &sid)
+                    {
+                        ++*epoch;
+                        cache->erase(sid);
+                    },
+                    [cache, epoch]()
+                    {
+                        ++*epoch;
+                        cache->clear();
+                    })
+            .detach();
     }
 
-    void remove(const std::string &sid)
+    // 新增登录会话(有过期时间，由网关根据长连接的存活情况定期续期)
+    void append(const std::string &sid,
+                const std::string &uid,
+                const std::chrono::seconds &ttl = std::chrono::seconds(600))
     {
-        _client->del(sid);
+        _client->set(sid, uid, ttl);
     }
 
-    // 获取用户id
-    sw::redis::OptionalString uid(const std::string &sid)
+    template <typename Batch>
+    void append(Batch &batch,
+                const std::string &sid,
+                const std::string &uid,
+                const std::chrono::seconds &ttl = std::chrono::seconds(600))
     {
-        return _client->get(sid);
+        batch.set(sid, uid, ttl);
     }
-};
-
-// 用户状态类
-class LoginStatus
-{
-private:
-    std::shared_ptr<sw::redis::Redis> _client;
 
-public:
-    using ptr = std::shared_ptr<LoginStatus>;
+    // 续期登录会话
+    template <typename Batch>
+    void expire(Batch &batch, const std::string &sid, const std::chrono::seconds &ttl)
+    {
+        batch.expire(sid, ttl);
+    }
 
-    LoginStatus(const std::shared_ptr<sw::redis::Redis> &client) : _client(client) {}
+    // 删除会话并通知所有实例失效本地缓存
+    void remove(const std::string &sid)
+    {
+        auto pipe = _client->pipeline(false);
+        remove(pipe, sid);
+        pipe.exec();
+    }
 
-    void append(const std::string &uid)
+    template <typename Batch>
+    void remove(Batch &batch, const std::string &sid)
     {
-        _client->set(uid, "");
+        if (_cache)
+        {
+            ++*_epoch;
+            _cache->erase(sid);
+        }
+        batch.del(sid);
+        batch.publish(invalidateChannel(), sid);
     }
 
-    void remove(const std::string &uid)
+    // 获取用户id
+    sw::redis::OptionalString uid(const std::string &sid)
     {
-        _client->del(uid);
+        if (!_cache)
+            return _client->get(sid);
+
+        std::string uid;
+        if (_cache->get(sid, uid))
+            return uid;
+
+        // 只缓存存在的会话，避免会话刚创建时被缓存为不存在
+        // 会话与剩余过期时间在一次往返中取回，缓存条目不会比redis中的会话存活更久
+        // 查询期间会话可能被删除，此时不写入缓存，避免已删除的会话在本地继续有效
+        uint64_t epoch = _epoch->load();
+        auto replies = _client->pipeline(false).get(sid).ttl(sid).exec();
+        auto res = replies.get<sw::redis::OptionalString>(0);
+        long long ttl = replies.get<long long>(1);
+        if (res && ttl != -2 && epoch == _epoch->load())
+        {
+            if (ttl >= 0)
+                _cache->put(sid, *res, std::chrono::seconds(ttl));
+            else
+                _cache->put(sid, *res);
+        }
+        return res;
     }
 
-    // 判断是否存在
-    bool exists(const std::string &uid)
+private:
+    // 会话失效通知的频道
+    static std::string invalidateChannel()
     {
-        auto res = _client->get(uid);
-        if (res)
-            return true;
-        return false;
+        return "loginSession:invalidate";
     }
 };
 
@@ -96,13 +209,16 @@ public:
     VerifyCode(const std::shared_ptr<sw::redis::Redis> &client) : _client(client) {}
 
     // 新增验证码(有过期时间 默认五分钟)
+    // 写入与设置过期时间放在同一个事务中，一次往返完成且不会留下没有过期时间的验证码
     void append(const std::string &cid, 
                 const std::string &phone, 
                 const std::string &code,
                 const std::chrono::seconds &t = std::chrono::seconds(300))
     {
-        _client->hset(cid, std::make_pair(phone, code));
-        _client->expire(cid, t);
+        auto tx = _client->transaction(true, false);
+        tx.hset(cid, std::make_pair(phone, code));
+        tx.expire(cid, t);
+        tx.exec();
     }
 
     void remove(const std::string &cid)
@@ -110,6 +226,12 @@ public:
         _client->del(cid);
     }
 
+    template <typename Batch>
+    void remove(Batch &batch, const std::string &cid)
+    {
+        batch.del(cid);
+    }
+
     // 获取验证码
     sw::redis::OptionalString code(const std::string &cid, const std::string &phone)
     {
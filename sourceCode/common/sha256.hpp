@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+
+namespace hjb
+{
+    // SHA-256摘要计算(基于OpenSSL EVP接口)，支持分块追加数据
+    class Sha256
+    {
+    private:
+        EVP_MD_CTX *_ctx;
+
+    public:
+        Sha256() : _ctx(EVP_MD_CTX_new())
+        {
+            EVP_DigestInit_ex(_ctx, EVP_sha256(), nullptr);
+        }
+
+        ~Sha256()
+        {
+            EVP_MD_CTX_free(_ctx);
+        }
+
+        Sha256(const Sha256 &) = delete;
+        Sha256 &operator=(const Sha256 &) = delete;
+
+        void update(const void *data, size_t len)
+        {
+            EVP_DigestUpdate(_ctx, data, len);
+        }
+
+        // 结束计算，返回小写十六进制形式的摘要
+        std::string hex()
+        {
+            unsigned char md[EVP_MAX_MD_SIZE];
+            unsigned int len = 0;
+            EVP_DigestFinal_ex(_ctx, md, &len);
+
+            static const char digits[] = "0123456789abcdef";
+            std::string out;
+            out.reserve(len * 2);
+            for (unsigned int i = 0; i < len; ++i)
+            {
+                out.push_back(digits[md[i] >> 4]);
+                out.push_back(digits[md[i] & 0xf]);
+            }
+            return out;
+        }
+
+        static std::string of(const std::string &data)
+        {
+            Sha256 sha;
+            sha.update(data.data(), data.size());
+            return sha.hex();
+        }
+
+        // 分块读取文件计算摘要，失败时返回空串
+        static std::string ofFile(const std::string &path)
+        {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return "";
+
+            Sha256 sha;
+            char buf[64 * 1024];
+            ssize_t n;
+            while ((n = read(fd, buf, sizeof(buf))) > 0)
+                sha.update(buf, n);
+            close(fd);
+            return n < 0 ? "" : sha.hex();
+        }
+    };
+}
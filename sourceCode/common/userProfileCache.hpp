@@ -0,0 +1,291 @@
+#pragma once
+
+#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <bthread/countdown_event.h>
+#include <sw/redis++/redis.h>
+
+#include "lruCache.hpp"
+#include "log.hpp"
+#include "redis.hpp"
+#include "channel.hpp"
+#include "user.pb.h"
+
+namespace hjb
+{
+    // 用户信息的本地缓存(供需要批量获取用户信息的子服务使用)
+    // 未命中的用户合并为一次批量调用；多个请求同时查询同一个用户时只有一个请求真正调用，其余请求等待其结果
+    // 用户服务修改用户信息后通过redis发布变更通知，所有实例失效对应条目，缓存的过期时间作为兜底
+    // 未开启缓存时直接调用加载函数
+    class UserProfileCache
+    {
+    public:
+        using ptr = std::shared_ptr<UserProfileCache>;
+        // 批量加载用户信息的函数，返回是否成功
+        using Loader = std::function<bool(const std::string &rid,
+                                          const std::vector<std::string> &userIds,
+                                          std::unordered_map<std::string, UserProto> &users)>;
+
+    private:
+        // 缓存数据，由订阅线程共同持有
+        struct Store
+        {
+            LruCache<std::string, UserProto> cache;
+            std::atomic<uint64_t> epoch{0}; // 每次失效时递增，加载期间发生过失效的结果不写入缓存
+
+            Store(size_t capacity, const std::chrono::seconds &ttl) : cache(capacity, ttl) {}
+
+            void invalidate(const std::string &uid)
+            {
+                ++epoch;
+                cache.erase(uid);
+            }
+
+            void clear()
+            {
+                ++epoch;
+                cache.clear();
+            }
+        };
+
+        // 一次正在进行的批量加载
+        struct Flight
+        {
+            bthread::CountdownEvent done{1};
+            bool ok = false;
+            std::unordered_map<std::string, UserProto> users;
+        };
+
+        std::shared_ptr<Store> _store; // 未开启缓存时为空
+        Loader _loader;
+        std::mutex _mutex;                                              // 保护在途加载表
+        std::unordered_map<std::string, std::shared_ptr<Flight>> _flights; // 正在加载的用户id与其所属的加载
+
+    public:
+        // capacity: 缓存的用户数量上限(不大于0或没有redis客户端时不开启缓存)  ttl: 缓存条目的存活时长  loader: 未命中时的批量加载函数
+        UserProfileCache(const std::shared_ptr<sw::redis::Redis> &client,
+                         int capacity,
+                         const std::chrono::seconds &ttl,
+                         const Loader &loader)
+            : _loader(loader)
+        {
+            if (!client || capacity <= 0)
+                return;
+
+            // 订阅用户信息变更通知
+            _store = std::make_shared<Store>(capacity, ttl);
+            auto store = _store;
+            std::thread(subscribeInvalidation, client, invalidateChannel(),
+                        [store](const std::string &uid)
+                        { store->invalidate(uid); },
+                        [store]()
+                        { store->clear(); })
+                .detach();
+        }
+
+        // 调用用户子服务批量获取用户信息的加载函数(头像只携带文件id，由客户端单独获取)
+        static Loader serviceLoader(const AllServiceChannel::ptr &channels, const std::string &userServiceName)
+        {
+            return [channels, userServiceName](const std::string &rid,
+                                               const std::vector<std::string> &userIds,
+                                               std::unordered_map<std::string, UserProto> &users) -> bool
+            {
+                auto channel = channels->choose(userServiceName);
+                if (!channel)
+                {
+                    ERROR("{} - 未找到用户管理子服务节点 - {}", rid, userServiceName);
+                    return false;
+                }
+
+                GetMultiUserInfoReq req;
+                GetMultiUserInfoResp resp;
+                req.set_requestid(rid);
+                req.set_photobyref(true);
+                for (auto &id : userIds)
+                    req.add_userids(id);
+
+                brpc::Controller cntl;
+                UserService_Stub stub(channel.get());
+                stub.GetMultiUserInfo(&cntl, &req, &resp, nullptr);
+                if (cntl.Failed())
+                {
+                    ERROR("{} - 用户子服务调用失败: {}", rid, cntl.ErrorText());
+                    return false;
+                }
+                if (!resp.success())
+                {
+                    ERROR("{} - 批量获取用户信息失败: {}", rid, resp.errmsg());
+                    return false;
+                }
+
+                for (const auto &user : resp.users())
+                    users.insert(std::make_pair(user.first, user.second));
+                return true;
+            };
+        }
+
+        // 批量获取用户信息，查询不到的用户不会出现在结果中
+        bool get(const std::string &rid,
+                 const std::vector<std::string> &userIds,
+                 std::unordered_map<std::string, UserProto> &users)
+        {
+            if (!_store)
+                return _loader(rid, userIds, users);
+
+            std::vector<std::string> misses;
+            for (auto &id : userIds)
+            {
+                UserProto user;
+                if (_store->cache.get(id, user))
+                    users[id] = user;
+                else
+                    misses.push_back(id);
+            }
+            if (misses.empty())
+                return true;
+
+            // 已经在加载中的用户等待对方的结果，其余用户由本请求合并加载
+            auto own = std::make_shared<Flight>();
+            std::vector<std::string> loads;
+            std::vector<std::shared_ptr<Flight>> waits;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                for (auto &id : misses)
+                {
+                    auto it = _flights.find(id);
+                    if (it == _flights.end())
+                    {
+                        _flights.emplace(id, own);
+                        loads.push_back(id);
+                    }
+                    else if (it->second != own && std::find(waits.begin(), waits.end(), it->second) == waits.end())
+                    {
+                        waits.push_back(it->second);
+                    }
+                }
+            }
+
+            bool ok = true;
+            if (!loads.empty())
+            {
+                // 无论加载函数正常返回还是抛出异常，都要移除在途记录并唤醒等待者，否则等待者会永远阻塞
+                // 抛出异常时加载结果保持为失败
+                struct Landing
+                {
+                    UserProfileCache *self;
+                    const std::vector<std::string> &loads;
+                    Flight *flight;
+
+                    ~Landing()
+                    {
+                        {
+                            std::unique_lock<std::mutex> lock(self->_mutex);
+                            for (auto &id : loads)
+                                self->_flights.erase(id);
+                        }
+                        flight->done.signal();
+                    }
+                };
+
+                {
+                    Landing landing{this, loads, own.get()};
+                    uint64_t epoch = _store->epoch.load();
+                    own->ok = _loader(rid, loads, own->users);
+                    if (own->ok && epoch == _store->epoch.load())
+                    {
+                        for (auto &user : own->users)
+                            _store->cache.put(user.first, user.second);
+                    }
+                }
+
+                ok = own->ok;
+                users.insert(own->users.begin(), own->users.end());
+            }
+
+            for (auto &flight : waits)
+            {
+                flight->done.wait();
+                if (!flight->ok)
+                {
+                    ok = false;
+                    continue;
+                }
+                for (auto &id : misses)
+                {
+                    auto it = flight->users.find(id);
+                    if (it != flight->users.end())
+                        users[id] = it->second;
+                }
+            }
+
+            return ok;
+        }
+
+        // 失效本实例中的条目
+        void invalidate(const std::string &uid)
+        {
+            if (_store)
+                _store->invalidate(uid);
+        }
+
+        // 发布用户信息变更通知(用户服务修改用户信息后调用)
+        static void publish(const std::shared_ptr<sw::redis::Redis> &client, const std::string &uid)
+        {
+            client->publish(invalidateChannel(), uid);
+        }
+
+        template <typename Batch>
+        static void publish(Batch &batch, const std::string &uid)
+        {
+            batch.publish(invalidateChannel(), uid);
+        }
+
+    private:
+        // 用户信息变更通知的频道
+        static std::string invalidateChannel()
+        {
+            return "userProfile:invalidate";
+        }
+    };
+
+    // 用户信息缓存的建造选项，由需要批量获取用户信息的子服务建造类继承
+    class UserProfileCacheBuilder
+    {
+    protected:
+        std::shared_ptr<sw::redis::Redis> _userCacheRedis; // redis客户端(用于接收用户信息变更通知)
+        int _userCacheSize = 0;
+        int _userCacheTtl = 0;
+
+    public:
+        // 构造redis客户端对象
+        void makeRedis(const std::string &host,
+                       int port,
+                       int db,
+                       bool keepAlive)
+        {
+            _userCacheRedis = RedisClientFactory::create(host, port, db, keepAlive);
+        }
+
+        // 开启用户信息的本地缓存，需要先构造redis客户端
+        // capacity: 缓存的用户数量上限(不大于0表示不开启)  ttl: 缓存条目的存活时长(秒)
+        void makeUserCache(int capacity, int ttl)
+        {
+            _userCacheSize = capacity;
+            _userCacheTtl = ttl;
+        }
+
+    protected:
+        // 构造用户信息获取对象，未开启缓存时直接调用用户子服务
+        UserProfileCache::ptr buildUserCache(const AllServiceChannel::ptr &channels, const std::string &userServiceName)
+        {
+            return std::make_shared<UserProfileCache>(_userCacheRedis, _userCacheSize, std::chrono::seconds(_userCacheTtl),
+                                                      UserProfileCache::serviceLoader(channels, userServiceName));
+        }
+    };
+}
\ No newline at end of file
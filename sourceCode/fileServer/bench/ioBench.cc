@@ -0,0 +1,131 @@
+// 文件服务磁盘读写实现的性能对比：标准库文件流 与 io_uring
+// 以bthread模拟brpc工作线程上的并发请求：workers为工作线程数，concurrency为同时进行的请求数
+// 文件流实现在读写期间占用工作线程，并发数超过工作线程数时请求只能排队；io_uring实现等待期间让出工作线程
+// 读阶段紧接写阶段执行，数据大多来自页缓存；需要测试冷读时请在两个阶段之间手动清空页缓存
+#include <gflags/gflags.h>
+#include <bthread/bthread.h>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <vector>
+#include <sys/stat.h>
+
+#include "log.hpp"
+#include "fileIO.hpp"
+#include "uringFileIO.hpp"
+
+DEFINE_string(dir, "./benchData", "测试文件所在目录");
+DEFINE_string(sizes, "4096,65536,1048576,16777216", "测试的文件大小(字节)，逗号分隔");
+DEFINE_string(concurrency, "1,8,32", "同时进行的请求数，逗号分隔");
+DEFINE_int32(workers, 4, "bthread工作线程数(模拟brpc工作线程)");
+DEFINE_int64(totalBytes, 256 * 1024 * 1024, "每组测试读写的数据总量");
+DEFINE_bool(sync, false, "写入后是否同步到磁盘(验证组提交)");
+DEFINE_int64(directBytes, 0, "io_uring实现下不小于该大小的文件以O_DIRECT读取，0表示不使用");
+
+struct Task
+{
+    hjb::FileIO *io;
+    bool write;
+    int index;
+    int files;
+    std::string data;
+    std::atomic<int> *next;
+    std::atomic<int> *errors;
+    std::vector<int64_t> *latencies; // 每个文件的耗时(微秒)
+};
+
+static std::string filePath(int i)
+{
+    return FLAGS_dir + "/" + std::to_string(i);
+}
+
+// 每个并发请求循环领取文件编号直到全部完成
+static void *runTask(void *arg)
+{
+    Task *task = static_cast<Task *>(arg);
+    std::string body;
+    int i;
+    while ((i = task->next->fetch_add(1)) < task->files)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = task->write ? task->io->write(filePath(i), task->data) : task->io->read(filePath(i), body);
+        (*task->latencies)[i] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        if (!ok)
+            ++*task->errors;
+    }
+    return nullptr;
+}
+
+static std::vector<int64_t> parseList(const std::string &list)
+{
+    std::vector<int64_t> values;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        values.push_back(std::stoll(item));
+    return values;
+}
+
+// 执行一组测试并输出吞吐量与延迟
+static void runPhase(const std::string &name, hjb::FileIO *io, bool write, int64_t size, int concurrency, int files)
+{
+    std::atomic<int> next(0);
+    std::atomic<int> errors(0);
+    std::vector<int64_t> latencies(files, 0);
+    std::vector<Task> tasks(concurrency);
+    std::vector<bthread_t> tids(concurrency);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < concurrency; ++i)
+    {
+        tasks[i] = Task{io, write, i, files, write ? std::string(size, 'a' + i % 26) : "", &next, &errors, &latencies};
+        bthread_start_background(&tids[i], nullptr, runTask, &tasks[i]);
+    }
+    for (auto tid : tids)
+        bthread_join(tid, nullptr);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-7s %-6s size=%-10ld conc=%-4d files=%-6d %10.1f MB/s %10.0f ops/s  p50=%ldus p99=%ldus errors=%d\n",
+           name.c_str(), write ? "write" : "read", size, concurrency, files,
+           size * files / seconds / (1024 * 1024), files / seconds,
+           latencies[files / 2], latencies[files * 99 / 100], errors.load());
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    hjb::initLogger(false, "", 0);
+    bthread_setconcurrency(FLAGS_workers);
+    mkdir(FLAGS_dir.c_str(), 0775);
+
+    std::vector<std::pair<std::string, hjb::FileIO::ptr>> backends;
+    backends.emplace_back("stream", std::make_shared<hjb::StreamFileIO>(FLAGS_sync));
+#ifdef HJB_IO_URING
+    hjb::UringFileIO::Options options;
+    options.directThreshold = FLAGS_directBytes;
+    auto uring = std::make_shared<hjb::UringFileIO>(FLAGS_sync, options);
+    if (uring->ready())
+        backends.emplace_back("uring", uring);
+#endif
+
+    int maxFiles = 0;
+    for (auto size : parseList(FLAGS_sizes))
+    {
+        int files = FLAGS_totalBytes / size > 0 ? FLAGS_totalBytes / size : 1;
+        maxFiles = files > maxFiles ? files : maxFiles;
+        for (auto concurrency : parseList(FLAGS_concurrency))
+        {
+            for (auto &backend : backends)
+            {
+                runPhase(backend.first, backend.second.get(), true, size, concurrency, files);
+                runPhase(backend.first, backend.second.get(), false, size, concurrency, files);
+            }
+        }
+    }
+
+    for (int i = 0; i < maxFiles; ++i)
+        unlink(filePath(i).c_str());
+    return 0;
+}
\ No newline at end of file
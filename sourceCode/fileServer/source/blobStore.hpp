@@ -0,0 +1,206 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "log.hpp"
+#include "util.hpp"
+#include "sha256.hpp"
+#include "fileIO.hpp"
+
+namespace hjb
+{
+    // 内容寻址的文件存储
+    // 文件内容按SHA-256摘要命名保存为 blobs/ab/cd/<摘要>，相同的内容只保存一份
+    // 对外仍然使用文件id：每个文件id是 ids/<id前两位>/<id> 处指向对应内容的硬链接，内容的引用计数即其硬链接数减一
+    // 两级目录扇出避免单个目录条目过多导致打开文件变慢；旧版本平铺在根目录下的文件仍可以按文件id读取
+    class BlobStore
+    {
+    public:
+        using ptr = std::shared_ptr<BlobStore>;
+
+    private:
+        std::string _root;
+        FileIO::ptr _io; // 磁盘读写实现
+
+        // 逐级创建目录
+        static bool makeDirs(const std::string &dir)
+        {
+            for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1))
+            {
+                std::string sub = dir.substr(0, pos);
+                if (!sub.empty() && mkdir(sub.c_str(), 0775) != 0 && errno != EEXIST)
+                {
+                    ERROR("创建目录 {} 失败：{}", sub, strerror(errno));
+                    return false;
+                }
+                if (pos == std::string::npos)
+                    return true;
+            }
+        }
+
+        static std::string parent(const std::string &path)
+        {
+            return path.substr(0, path.find_last_of('/'));
+        }
+
+        // 文件id由服务端生成，拒绝可能跳出存储目录的id
+        static bool validId(const std::string &fid)
+        {
+            return fid.size() >= 2 && fid.find('/') == std::string::npos && fid != "..";
+        }
+
+        std::string blobPath(const std::string &hash)
+        {
+            return _root + "blobs/" + hash.substr(0, 2) + "/" + hash.substr(2, 2) + "/" + hash;
+        }
+
+        std::string idPath(const std::string &fid)
+        {
+            return _root + "ids/" + fid.substr(0, 2) + "/" + fid;
+        }
+
+        // 为内容建立文件id(创建硬链接)，内容恰好被并发删除时返回false
+        bool link(const std::string &src, const std::string &fid)
+        {
+            std::string path = idPath(fid);
+            if (!makeDirs(parent(path)))
+                return false;
+
+            if (::link(src.c_str(), path.c_str()) != 0)
+            {
+                if (errno != ENOENT)
+                    ERROR("创建文件 {} 的引用失败：{}", src, strerror(errno));
+                return false;
+            }
+            return true;
+        }
+
+    public:
+        BlobStore(const std::string &root, const FileIO::ptr &io) : _root(root), _io(io)
+        {
+            if (_root.back() != '/')
+                _root.push_back('/');
+            makeDirs(_root + "blobs");
+            makeDirs(_root + "ids");
+            makeDirs(_root + "tmp");
+        }
+
+        static bool validHash(const std::string &hash)
+        {
+            if (hash.size() != 64)
+                return false;
+            for (char c : hash)
+            {
+                if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+                    return false;
+            }
+            return true;
+        }
+
+        // 文件id对应的读取路径，不合法的id返回空串
+        std::string path(const std::string &fid)
+        {
+            if (!validId(fid))
+                return "";
+
+            std::string path = idPath(fid);
+            if (access(path.c_str(), F_OK) == 0)
+                return path;
+            return _root + fid;
+        }
+
+        // 新的临时文件路径(与内容目录位于同一文件系统，保证改名是原子的)
+        std::string tmpPath()
+        {
+            return _root + "tmp/" + uuid();
+        }
+
+        // 按摘要引用已有内容：内容存在且大小一致时生成新的文件id，否则返回空串
+        // suffix: 附加在文件id末尾的上传者标记
+        std::string ref(const std::string &hash, uint64_t size, const std::string &suffix = "")
+        {
+            if (!validHash(hash))
+                return "";
+
+            std::string blob = blobPath(hash);
+            struct stat st;
+            if (stat(blob.c_str(), &st) != 0 || (uint64_t)st.st_size != size)
+                return "";
+
+            std::string fid = uuid() + suffix;
+            return link(blob, fid) ? fid : "";
+        }
+
+        // 将写好的临时文件作为内容保存在指定的文件id下，内容已存在时丢弃临时文件
+        bool commit(const std::string &tmp, const std::string &hash, const std::string &fid)
+        {
+            if (!validId(fid))
+                return false;
+
+            // 内容已存在：直接引用
+            std::string blob = blobPath(hash);
+            if (link(blob, fid))
+            {
+                unlink(tmp.c_str());
+                return true;
+            }
+
+            // 先为临时文件建立文件id的链接再改名为内容文件，改名前后引用计数都不为零，不会被并发的删除误回收
+            // 相同内容并发写入时后改名的一方覆盖前者的内容名，先写入的文件id仍指向自己的副本，数据不受影响
+            bool ok = link(tmp, fid);
+            if (ok && (!makeDirs(parent(blob)) || rename(tmp.c_str(), blob.c_str()) != 0))
+                WARN("登记内容 {} 失败，该文件不参与去重：{}", hash, strerror(errno));
+            unlink(tmp.c_str());
+            return ok;
+        }
+
+        // 保存数据并生成文件id，失败时返回空串
+        std::string put(const std::string &data, const std::string &suffix = "")
+        {
+            std::string hash = Sha256::of(data);
+            std::string fid = ref(hash, data.size(), suffix);
+            if (!fid.empty())
+                return fid;
+
+            std::string tmp = tmpPath();
+            if (!_io->write(tmp, data))
+            {
+                unlink(tmp.c_str());
+                return "";
+            }
+
+            fid = uuid() + suffix;
+            return commit(tmp, hash, fid) ? fid : "";
+        }
+
+        // 删除文件id，最后一个引用被删除时一并删除内容
+        // 文件id不记录摘要，只有在删除最后一个引用时才需要重新计算摘要找到内容文件
+        bool remove(const std::string &fid)
+        {
+            if (!validId(fid))
+                return false;
+
+            std::string path = idPath(fid);
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0)
+                return unlink((_root + fid).c_str()) == 0;
+
+            std::string hash = st.st_nlink <= 2 ? Sha256::ofFile(path) : "";
+            if (unlink(path.c_str()) != 0)
+                return false;
+            if (hash.empty())
+                return true;
+
+            // 删除前再次确认内容没有新的引用；即使与新的引用并发，内容数据仍由新的硬链接持有
+            std::string blob = blobPath(hash);
+            if (stat(blob.c_str(), &st) == 0 && st.st_nlink == 1)
+                unlink(blob.c_str());
+            return true;
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "log.hpp"
+#include "util.hpp"
+#include "sha256.hpp"
+
+namespace hjb
+{
+    // 分块上传的进度记录
+    // 每次上传在目录下保存两个文件：<id>.meta 记录文件大小、上传用户与文件名，<id>.data 为已接收的数据
+    // 已接收的字节数即数据文件的大小，服务重启后仍然可以继续上传；长时间未更新的上传会被清理
+    // 目录与文件存储一样需要位于所有文件服务节点共享的存储上：节点下线或被熔断后，后续分块可以由任一节点继续接收
+    // 上传id以上传用户的标记开头，便于统计每个用户进行中的上传数量
+    class ChunkUploads
+    {
+    public:
+        using ptr = std::shared_ptr<ChunkUploads>;
+
+        // 同一上传的互斥锁：进程内由分段互斥锁串行，跨节点由进度文件上的文件锁串行
+        class Lock
+        {
+        private:
+            std::unique_lock<std::mutex> _guard;
+            int _fd;
+
+        public:
+            Lock(std::mutex &mutex, const std::string &path)
+                : _guard(mutex), _fd(open(path.c_str(), O_RDONLY))
+            {
+                if (_fd >= 0 && flock(_fd, LOCK_EX) != 0)
+                    ERROR("锁定上传 {} 失败：{}", path, strerror(errno));
+            }
+
+            Lock(Lock &&other) : _guard(std::move(other._guard)), _fd(other._fd)
+            {
+                other._fd = -1;
+            }
+
+            Lock(const Lock &) = delete;
+            Lock &operator=(const Lock &) = delete;
+
+            // 关闭文件即释放文件锁
+            ~Lock()
+            {
+                if (_fd >= 0)
+                    close(_fd);
+            }
+        };
+
+        struct State
+        {
+            std::string userId;
+            std::string fileName;
+            uint64_t fileSize = 0;
+            uint64_t received = 0; // 已接收的字节数
+        };
+
+    private:
+        static const int STRIPES = 64;          // 上传锁的分段数量
+        static const int SWEEP_INTERVAL = 600;  // 清理过期上传的最小间隔(秒)
+
+        std::string _dir;
+        time_t _expire; // 上传的过期时长(秒)
+        std::mutex _locks[STRIPES];
+        std::atomic<time_t> _lastSweep;
+
+        std::string metaPath(const std::string &id)
+        {
+            return _dir + id + ".meta";
+        }
+
+        // 上传用户的标记(用户id摘要的前缀)，用作上传id的前缀
+        static std::string userTag(const std::string &userId)
+        {
+            return Sha256::of(userId).substr(0, 8) + "_";
+        }
+
+    public:
+        // dir: 进度记录所在目录(需要与文件存储位于同一文件系统)  expire: 上传的过期时长(秒)
+        ChunkUploads(const std::string &dir, time_t expire)
+            : _dir(dir), _expire(expire), _lastSweep(0)
+        {
+            if (_dir.back() != '/')
+                _dir.push_back('/');
+            mkdir(_dir.c_str(), 0775);
+        }
+
+        // 上传标识由服务端生成，拒绝可能跳出目录的标识
+        static bool validId(const std::string &id)
+        {
+            return !id.empty() && id.find('/') == std::string::npos && id[0] != '.';
+        }
+
+        std::string dataPath(const std::string &id)
+        {
+            return _dir + id + ".data";
+        }
+
+        // 同一上传的操作需要互斥，调用方在整个操作期间持有返回的锁
+        Lock lock(const std::string &id)
+        {
+            return Lock(_locks[std::hash<std::string>()(id) % STRIPES], validId(id) ? metaPath(id) : "");
+        }
+
+        // 用户进行中的上传数量
+        size_t pending(const std::string &userId)
+        {
+            std::string tag = userTag(userId);
+            size_t count = 0;
+            DIR *dir = opendir(_dir.c_str());
+            if (!dir)
+                return 0;
+
+            struct dirent *entry;
+            while ((entry = readdir(dir)) != nullptr)
+            {
+                std::string name = entry->d_name;
+                if (name.compare(0, tag.size(), tag) == 0 && name.size() > 5 && name.compare(name.size() - 5, 5, ".meta") == 0)
+                    ++count;
+            }
+            closedir(dir);
+            return count;
+        }
+
+        // 开始一次上传，返回上传标识，失败时返回空串
+        std::string create(const std::string &userId, const std::string &fileName, uint64_t fileSize)
+        {
+            std::string id = userTag(userId) + uuid();
+            std::string data = dataPath(id);
+            int fd = open(data.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0664);
+            if (fd < 0)
+            {
+                ERROR("创建上传文件 {} 失败：{}", data, strerror(errno));
+                return "";
+            }
+            close(fd);
+
+            std::string meta = std::to_string(fileSize) + "\n" + userId + "\n" + fileName;
+            if (!writeFile(metaPath(id), meta))
+            {
+                unlink(data.c_str());
+                return "";
+            }
+            return id;
+        }
+
+        // 读取上传进度，上传不存在时返回false
+        bool load(const std::string &id, State &state)
+        {
+            if (!validId(id))
+                return false;
+
+            std::ifstream ifs(metaPath(id));
+            std::string size;
+            if (!std::getline(ifs, size) || !std::getline(ifs, state.userId))
+                return false;
+            std::getline(ifs, state.fileName, '\0');
+            state.fileSize = strtoull(size.c_str(), nullptr, 10);
+
+            struct stat st;
+            if (stat(dataPath(id).c_str(), &st) != 0)
+                return false;
+            state.received = st.st_size;
+            return true;
+        }
+
+        // 在已接收的数据之后追加分块，写入不完整时回退到追加前的大小
+        bool append(const std::string &id, uint64_t offset, const std::string &chunk)
+        {
+            std::string path = dataPath(id);
+            int fd = open(path.c_str(), O_WRONLY);
+            if (fd < 0)
+            {
+                ERROR("打开上传文件 {} 失败：{}", path, strerror(errno));
+                return false;
+            }
+
+            size_t written = 0;
+            while (written < chunk.size())
+            {
+                ssize_t n = pwrite(fd, chunk.data() + written, chunk.size() - written, offset + written);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    ERROR("写入上传文件 {} 失败：{}", path, strerror(errno));
+                    ftruncate(fd, offset);
+                    close(fd);
+                    return false;
+                }
+                written += n;
+            }
+            close(fd);
+            return true;
+        }
+
+        // 删除上传的进度记录(数据文件已被转存时只剩进度文件)
+        void remove(const std::string &id)
+        {
+            unlink(dataPath(id).c_str());
+            unlink(metaPath(id).c_str());
+        }
+
+        // 清理长时间未更新的上传，两次清理之间至少间隔 SWEEP_INTERVAL 秒
+        void sweep()
+        {
+            time_t now = time(nullptr);
+            time_t last = _lastSweep.load();
+            if (now - last < SWEEP_INTERVAL || !_lastSweep.compare_exchange_strong(last, now))
+                return;
+
+            DIR *dir = opendir(_dir.c_str());
+            if (!dir)
+                return;
+
+            struct dirent *entry;
+            while ((entry = readdir(dir)) != nullptr)
+            {
+                std::string name = entry->d_name;
+                if (name.size() <= 5 || name.compare(name.size() - 5, 5, ".meta") != 0)
+                    continue;
+
+                std::string id = name.substr(0, name.size() - 5);
+                auto guard = lock(id);
+                struct stat st;
+                if (stat(dataPath(id).c_str(), &st) != 0 && stat(metaPath(id).c_str(), &st) != 0)
+                    continue;
+                if (now - st.st_mtime > _expire)
+                {
+                    DEBUG("清理过期的上传 {}", id);
+                    remove(id);
+                }
+            }
+            closedir(dir);
+        }
+    };
+}
\ No newline at end of file
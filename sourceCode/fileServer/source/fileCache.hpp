@@ -0,0 +1,219 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <butil/iobuf.h>
+#include <bvar/bvar.h>
+
+namespace hjb
+{
+    // 访问频率估计(Count-Min Sketch)，TinyLFU的准入依据
+    // 每个键映射到每行的一个计数器，取各行最小值作为频率估计；累计次数达到上限后所有计数减半，使旧的热点逐渐冷却
+    class FrequencySketch
+    {
+    private:
+        static const int DEPTH = 4;
+        static const uint8_t MAX_COUNT = 15;
+
+        std::vector<uint8_t> _counters; // DEPTH行计数器连续存放
+        size_t _width;                  // 每行的计数器数量(2的幂)
+        size_t _additions;              // 上次减半以来的累计次数
+        size_t _resetAt;                // 累计次数达到此值时减半
+
+        size_t index(size_t hash, int row) const
+        {
+            // 双重哈希：由一个哈希值派生出每行的位置
+            size_t h = hash + row * ((hash >> 32) | 1);
+            return row * _width + (h & (_width - 1));
+        }
+
+    public:
+        FrequencySketch(size_t width)
+            : _width(1), _additions(0)
+        {
+            while (_width < width)
+                _width <<= 1;
+            _counters.assign(DEPTH * _width, 0);
+            _resetAt = 10 * _width;
+        }
+
+        void increment(size_t hash)
+        {
+            for (int i = 0; i < DEPTH; ++i)
+            {
+                uint8_t &c = _counters[index(hash, i)];
+                if (c < MAX_COUNT)
+                    ++c;
+            }
+
+            if (++_additions >= _resetAt)
+            {
+                for (auto &c : _counters)
+                    c >>= 1;
+                _additions /= 2;
+            }
+        }
+
+        uint8_t frequency(size_t hash) const
+        {
+            uint8_t freq = MAX_COUNT;
+            for (int i = 0; i < DEPTH; ++i)
+            {
+                uint8_t c = _counters[index(hash, i)];
+                if (c < freq)
+                    freq = c;
+            }
+            return freq;
+        }
+    };
+
+    // 热点文件的内存缓存
+    // 按字节数限制容量，键按哈希分散到多个分片，分片内部按最近访问顺序淘汰
+    // 新文件只有在估计访问频率高于将被淘汰的文件时才会被缓存(TinyLFU)，一次性的批量读取不会冲掉头像等热点文件
+    // 文件数据以IOBuf保存，读取时只增加数据块的引用计数，不拷贝数据；文件ID对应的内容不会改变，因此不需要失效
+    class FileCache
+    {
+    public:
+        using ptr = std::shared_ptr<FileCache>;
+
+    private:
+        struct Entry
+        {
+            std::string fid;
+            butil::IOBuf data;
+        };
+
+        struct Shard
+        {
+            std::mutex mutex;
+            std::list<Entry> entries; // 表头为最近访问的条目
+            std::unordered_map<std::string, std::list<Entry>::iterator> index;
+            FrequencySketch sketch;
+            size_t bytes = 0; // 当前缓存的字节数
+
+            Shard(size_t width) : sketch(width) {}
+        };
+
+        size_t _capacity; // 每个分片的字节数上限
+        size_t _maxFile;  // 可缓存的单个文件大小上限
+        std::vector<std::unique_ptr<Shard>> _shards;
+
+        bvar::Adder<int64_t> _hits;
+        bvar::Adder<int64_t> _misses;
+        bvar::Adder<int64_t> _rejects; // 未通过准入的文件数量
+        bvar::Window<bvar::Adder<int64_t>> _recentHits;
+        bvar::Window<bvar::Adder<int64_t>> _recentMisses;
+        bvar::PassiveStatus<double> _hitRate; // 统计窗口内的命中率
+        bvar::PassiveStatus<int64_t> _bytes;  // 当前缓存的总字节数
+
+        Shard &shard(size_t hash)
+        {
+            return *_shards[hash % _shards.size()];
+        }
+
+        static double hitRate(void *arg)
+        {
+            FileCache *cache = static_cast<FileCache *>(arg);
+            int64_t hits = cache->_recentHits.get_value();
+            int64_t total = hits + cache->_recentMisses.get_value();
+            return total > 0 ? (double)hits / total : 0;
+        }
+
+        static int64_t totalBytes(void *arg)
+        {
+            FileCache *cache = static_cast<FileCache *>(arg);
+            int64_t bytes = 0;
+            for (auto &s : cache->_shards)
+            {
+                std::unique_lock<std::mutex> lock(s->mutex);
+                bytes += s->bytes;
+            }
+            return bytes;
+        }
+
+    public:
+        // capacity: 缓存的总字节数  maxFile: 可缓存的单个文件大小上限  shards: 分片数量
+        // 统计值暴露到brpc的内置监控中，命名为 file_cache_*
+        FileCache(size_t capacity, size_t maxFile, size_t shards = 16)
+            : _capacity(capacity / (shards > 0 ? shards : 1)),
+              _maxFile(maxFile),
+              _rejects("file_cache_reject"),
+              _recentHits("file_cache_hit", &_hits, 10),
+              _recentMisses("file_cache_miss", &_misses, 10),
+              _hitRate("file_cache_hit_rate", hitRate, this),
+              _bytes("file_cache_bytes", totalBytes, this)
+        {
+            // 频率估计按每个分片约能容纳的文件数量(平均按16KB估算)确定规模
+            size_t width = _capacity / (16 * 1024);
+            for (size_t i = 0; i < (shards > 0 ? shards : 1); ++i)
+                _shards.emplace_back(new Shard(width > 64 ? width : 64));
+        }
+
+        // 查找文件，命中时data与缓存共享数据块
+        bool get(const std::string &fid, butil::IOBuf &data)
+        {
+            size_t hash = std::hash<std::string>()(fid);
+            Shard &s = shard(hash);
+            std::unique_lock<std::mutex> lock(s.mutex);
+
+            s.sketch.increment(hash);
+            auto it = s.index.find(fid);
+            if (it == s.index.end())
+            {
+                _misses << 1;
+                return false;
+            }
+
+            s.entries.splice(s.entries.begin(), s.entries, it->second);
+            data = it->second->data;
+            _hits << 1;
+            return true;
+        }
+
+        // 是否值得尝试缓存该大小的文件
+        bool cacheable(size_t size) const
+        {
+            return size <= _maxFile && size <= _capacity;
+        }
+
+        // 缓存文件，分片已满时只有访问频率高于淘汰对象的文件才会被缓存
+        void put(const std::string &fid, const butil::IOBuf &data)
+        {
+            if (!cacheable(data.size()))
+                return;
+
+            size_t hash = std::hash<std::string>()(fid);
+            Shard &s = shard(hash);
+            std::unique_lock<std::mutex> lock(s.mutex);
+
+            if (s.index.count(fid))
+                return;
+
+            if (s.bytes + data.size() > _capacity && !s.entries.empty())
+            {
+                const Entry &victim = s.entries.back();
+                size_t victimHash = std::hash<std::string>()(victim.fid);
+                if (s.sketch.frequency(hash) <= s.sketch.frequency(victimHash))
+                {
+                    _rejects << 1;
+                    return;
+                }
+            }
+
+            while (s.bytes + data.size() > _capacity && !s.entries.empty())
+            {
+                s.bytes -= s.entries.back().data.size();
+                s.index.erase(s.entries.back().fid);
+                s.entries.pop_back();
+            }
+
+            s.entries.push_front(Entry{fid, data});
+            s.index[fid] = s.entries.begin();
+            s.bytes += data.size();
+        }
+    };
+}
\ No newline at end of file
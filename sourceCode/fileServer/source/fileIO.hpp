@@ -0,0 +1,112 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "log.hpp"
+#include "util.hpp"
+
+namespace hjb
+{
+    // 文件服务的磁盘读写接口
+    // durable为true时写入的文件在返回前同步到磁盘，否则与原先一样只写入页缓存
+    class FileIO
+    {
+    public:
+        using ptr = std::shared_ptr<FileIO>;
+
+    protected:
+        bool _durable;
+
+    public:
+        FileIO(bool durable) : _durable(durable) {}
+        virtual ~FileIO() {}
+
+        // 读取整个文件
+        virtual bool read(const std::string &path, std::string &body) = 0;
+        // 读取文件中从offset开始的length字节，文件不足length字节时返回false
+        virtual bool read(const std::string &path, uint64_t offset, uint64_t length, std::string &body) = 0;
+        // 写入整个文件(覆盖原有内容)
+        virtual bool write(const std::string &path, const std::string &body) = 0;
+        // 按配置将已写入fd的数据同步到磁盘
+        virtual bool flush(int fd) = 0;
+    };
+
+    // 阻塞式的实现(原有实现)：以标准库文件流读取，以write写入并指定文件权限，读写期间阻塞调用线程
+    class StreamFileIO : public FileIO
+    {
+    public:
+        StreamFileIO(bool durable) : FileIO(durable) {}
+
+        bool read(const std::string &path, std::string &body) override
+        {
+            return readFile(path, body);
+        }
+
+        bool read(const std::string &path, uint64_t offset, uint64_t length, std::string &body) override
+        {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                ERROR("打开文件 {} 失败：{}", path, strerror(errno));
+                return false;
+            }
+
+            body.resize(length);
+            size_t done = 0;
+            while (done < length)
+            {
+                ssize_t n = pread(fd, &body[done], length - done, offset + done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    ERROR("读取文件 {} 数据失败：{}", path, n < 0 ? strerror(errno) : "文件长度不足");
+                    close(fd);
+                    return false;
+                }
+                done += n;
+            }
+
+            close(fd);
+            return true;
+        }
+
+        bool write(const std::string &path, const std::string &body) override
+        {
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0664);
+            if (fd < 0)
+            {
+                ERROR("打开文件 {} 失败：{}", path, strerror(errno));
+                return false;
+            }
+
+            size_t written = 0;
+            while (written < body.size())
+            {
+                ssize_t n = ::write(fd, body.data() + written, body.size() - written);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    ERROR("写入文件 {} 数据失败：{}", path, strerror(errno));
+                    close(fd);
+                    return false;
+                }
+                written += n;
+            }
+
+            bool ok = flush(fd);
+            close(fd);
+            return ok;
+        }
+
+        bool flush(int fd) override
+        {
+            return !_durable || fdatasync(fd) == 0;
+        }
+    };
+}
\ No newline at end of file
@@ -13,6 +13,14 @@ DEFINE_int32(listenPort, 7500, "Rpc服务器监听端口");
 DEFINE_int32(rpcTimeout, -1, "Rpc调用超时时间");
 DEFINE_int32(rpcThreads, 1, "Rpc的IO线程数量");
 
+DEFINE_string(ioBackend, "stream", "磁盘读写实现，stream-标准库文件流； uring-io_uring(需要以WITH_IO_URING编译)；");
+DEFINE_bool(fileSync, false, "上传的文件是否在返回前同步到磁盘");
+DEFINE_int64(directBytes, 0, "io_uring实现下不小于该大小的文件以O_DIRECT读取，0表示不使用");
+DEFINE_int32(groupCommitUs, 1000, "io_uring实现下同步请求的攒批窗口(微秒)");
+
+DEFINE_int64(cacheBytes, 256 * 1024 * 1024, "热点文件缓存的总字节数");
+DEFINE_int64(cacheMaxFile, 1024 * 1024, "可缓存的单个文件大小上限");
+
 int main(int argc, char *argv[])
 {
     google::ParseCommandLineFlags(&argc, &argv, true);
@@ -21,6 +29,8 @@ int main(int argc, char *argv[])
     // 建造语音识别服务器的各个客户端
     hjb::FileServerBuild fsb;
     fsb.makeRegClient(FLAGS_registryHost, FLAGS_baseService + FLAGS_instanceName, FLAGS_accessHost);
+    fsb.makeFileIO(FLAGS_ioBackend, FLAGS_fileSync, FLAGS_directBytes, FLAGS_groupCommitUs);
+    fsb.makeFileCache(FLAGS_cacheBytes, FLAGS_cacheMaxFile);
     fsb.makeRpcServer(FLAGS_listenPort, FLAGS_rpcTimeout, FLAGS_rpcThreads);
 
     // 建造语音识别服务器
@@ -1,28 +1,214 @@
 #include <brpc/server.h>
+#include <brpc/stream.h>
+#include <bthread/bthread.h>
 #include <butil/logging.h>
+#include <butil/iobuf.h>
+#include <butil/crc32c.h>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "log.hpp"
 #include "etcd.hpp"
 #include "file.pb.h"
 #include "base.pb.h"
 #include "util.hpp"
+#include "blobStore.hpp"
+#include "fileCache.hpp"
+#include "fileIO.hpp"
+#include "uringFileIO.hpp"
+#include "chunkUpload.hpp"
+#include "fileUpload.hpp"
 
 namespace hjb
 {
+    // 流式上传的接收端
+    // 数据先写入临时文件并同时计算摘要，收满声明的大小后存入内容存储并在流上回复确认
+    // 流异常关闭或数据超出声明大小时删除临时文件；流上未消费的数据受brpc流量控制限制，内存占用与文件大小无关
+    class UploadStream : public brpc::StreamInputHandler
+    {
+    private:
+        BlobStore::ptr _store;
+        FileIO::ptr _io;
+        int _fd;
+        std::string _tmpPath;  // 临时文件路径
+        std::string _fid;      // 文件id
+        uint64_t _expect;      // 声明的文件大小
+        uint64_t _received;    // 已接收的字节数
+        Sha256 _sha;           // 已接收数据的摘要
+        bool _done;            // 是否已经完整落盘
+        bool _failed;
+
+        void fail(brpc::StreamId id, const std::string &reason)
+        {
+            ERROR("流式上传 {} 失败：{}", _fid, reason);
+            _failed = true;
+            brpc::StreamClose(id);
+        }
+
+    public:
+        UploadStream(const BlobStore::ptr &store, const FileIO::ptr &io, int fd, const std::string &tmpPath, const std::string &fid, uint64_t expect)
+            : _store(store), _io(io), _fd(fd), _tmpPath(tmpPath), _fid(fid), _expect(expect), _received(0), _done(false), _failed(false)
+        {
+        }
+
+        int on_received_messages(brpc::StreamId id, butil::IOBuf *const messages[], size_t size) override
+        {
+            for (size_t i = 0; i < size && !_failed; ++i)
+            {
+                butil::IOBuf *buf = messages[i];
+                _received += buf->size();
+                if (_received > _expect)
+                {
+                    fail(id, "数据超出声明的文件大小");
+                    return 0;
+                }
+
+                for (size_t j = 0; j < buf->backing_block_num(); ++j)
+                {
+                    butil::StringPiece block = buf->backing_block(j);
+                    _sha.update(block.data(), block.size());
+                }
+
+                // 直接从IOBuf的数据块写入文件，不拷贝到连续内存
+                while (!buf->empty() && !_failed)
+                {
+                    if (buf->cut_into_file_descriptor(_fd) < 0 && errno != EINTR)
+                        fail(id, strerror(errno));
+                }
+            }
+
+            if (!_failed && !_done && _received == _expect)
+            {
+                // 按配置同步到磁盘后再关闭文件
+                bool ok = _io->flush(_fd);
+                ok = close(_fd) == 0 && ok;
+                _fd = -1;
+                if (!ok)
+                {
+                    fail(id, "写入文件数据失败");
+                    return 0;
+                }
+                if (!_store->commit(_tmpPath, _sha.hex(), _fid))
+                {
+                    fail(id, "保存文件失败");
+                    return 0;
+                }
+                _done = true;
+
+                butil::IOBuf ack;
+                ack.append("ok");
+                brpc::StreamWrite(id, ack);
+                brpc::StreamClose(id);
+            }
+            return 0;
+        }
+
+        void on_idle_timeout(brpc::StreamId id) override
+        {
+            fail(id, "流空闲超时");
+        }
+
+        void on_closed(brpc::StreamId id) override
+        {
+            if (_fd >= 0)
+                close(_fd);
+            if (!_done)
+                unlink(_tmpPath.c_str());
+            delete this;
+        }
+    };
+
     // 语音识别服务类
     class FileServiceImpl : public FileService
     {
     private:
-        std::string _storagePath;
+        static const uint64_t MAX_RANGE = 4 * 1024 * 1024; // 分段下载单次返回的数据上限
+        static const int STREAM_IDLE_MS = 30 * 1000;       // 流式上传的空闲超时
+        static const uint64_t MAX_BATCH = 32 * 1024 * 1024; // 多文件下载单次响应的数据上限
+        static const int MAX_PARALLEL = 16;                 // 多文件下载同时读取的文件数量
+        static const uint64_t MAX_CHUNK = 4 * 1024 * 1024;  // 分块上传单个分块的数据上限
+        static const time_t UPLOAD_EXPIRE = 24 * 3600;      // 分块上传的过期时长(秒)
+        static const uint64_t MAX_UPLOAD = 4ULL * 1024 * 1024 * 1024; // 分块上传的文件大小上限
+        static const size_t MAX_PENDING_UPLOADS = 8;        // 每个用户同时进行的分块上传数量上限
+
+        FileIO::ptr _io;       // 磁盘读写实现
+        BlobStore::ptr _store; // 内容寻址的文件存储
+        FileCache::ptr _cache; // 热点文件缓存
+        ChunkUploads::ptr _uploads; // 分块上传的进度记录
+
+        // 多文件下载中的一个读取任务
+        struct ReadTask
+        {
+            FileServiceImpl *service;
+            std::string fid;
+            std::string body;
+            bool ok;
+        };
+
+        static void *runReadTask(void *arg)
+        {
+            ReadTask *task = static_cast<ReadTask *>(arg);
+            task->ok = task->service->loadFile(task->fid, task->body);
+            return nullptr;
+        }
+
+        // 读取整个文件到protobuf字段，优先从缓存中读取，未命中时读取磁盘并尝试缓存
+        // 缓存命中时仍需拷贝一次数据，只省去磁盘读取；需要免拷贝时使用IOBuf版本
+        bool readFile(const std::string &fid, std::string &body)
+        {
+            butil::IOBuf data;
+            if (_cache->get(fid, data))
+            {
+                data.copy_to(&body);
+                return true;
+            }
+            return loadFile(fid, body);
+        }
+
+        // 读取整个文件到IOBuf，缓存命中时与缓存共享数据块，不拷贝数据
+        bool readFile(const std::string &fid, butil::IOBuf &data)
+        {
+            if (_cache->get(fid, data))
+                return true;
+            return loadFile(fid, data);
+        }
+
+        // 从磁盘读取整个文件到IOBuf并尝试缓存
+        bool loadFile(const std::string &fid, butil::IOBuf &data)
+        {
+            std::string body;
+            if (!_io->read(_store->path(fid), body))
+                return false;
+            data.append(body);
+            if (_cache->cacheable(data.size()))
+                _cache->put(fid, data);
+            return true;
+        }
+
+        // 从磁盘读取整个文件并尝试缓存
+        bool loadFile(const std::string &fid, std::string &body)
+        {
+            if (!_io->read(_store->path(fid), body))
+                return false;
+
+            if (_cache->cacheable(body.size()))
+            {
+                butil::IOBuf data;
+                data.append(body);
+                _cache->put(fid, data);
+            }
+            return true;
+        }
 
     public:
-        FileServiceImpl(const std::string &storagePath)
-            : _storagePath(storagePath)
+        FileServiceImpl(const std::string &storagePath, const FileIO::ptr &io, const FileCache::ptr &cache)
+            : _io(io),
+              _store(std::make_shared<BlobStore>(storagePath, io)),
+              _cache(cache),
+              _uploads(std::make_shared<ChunkUploads>(storagePath + "/uploads", UPLOAD_EXPIRE))
         {
-            umask(0);
-            mkdir(storagePath.c_str(), 0775);
-            if (_storagePath.back() != '/')
-                _storagePath.push_back('/');
         }
 
         ~FileServiceImpl()
@@ -40,14 +226,16 @@ namespace hjb
 
             response->set_requestid(request->requestid());
 
-            // 取出请求中的文件ID（单文件也就是文件名）
+            // 取出请求中的文件ID
             std::string fid = request->fileid();
-            std::string filename = _storagePath + fid;
 
-            // 读取文件数据
-            std::string body;
-            if (!hjb::readFile(filename, body))
+            // 以附件返回时直接追加缓存中的数据块；否则直接读入响应对象，省去一次整文件拷贝
+            bool ok = request->attachment()
+                          ? readFile(fid, static_cast<brpc::Controller *>(cntl_base)->response_attachment())
+                          : readFile(fid, *response->mutable_filedata()->mutable_filecontent());
+            if (!ok)
             {
+                response->clear_filedata();
                 response->set_success(false);
                 response->set_errmsg("读取文件数据失败");
                 ERROR("{} 读取文件数据失败", request->requestid());
@@ -57,10 +245,11 @@ namespace hjb
             // 组织响应
             response->set_success(true);
             response->mutable_filedata()->set_fileid(fid);
-            response->mutable_filedata()->set_filecontent(body);
         }
 
         // 多文件下载
+        // 各文件并行读取，单个文件失败不影响其余文件，失败的文件在 failedFiles 中返回原因
+        // 文件数据总量超过单次上限时，剩余文件ID在 pendingFileIds 中返回，由调用方再次请求
         void GetMultiFile(google::protobuf::RpcController *cntl_base,
                           const ::hjb::GetMultiFileReq *request,
                           ::hjb::GetMultiFileResp *response,
@@ -71,25 +260,91 @@ namespace hjb
 
             response->set_requestid(request->requestid());
 
-            // 循环取出请求中的文件ID，读取文件数据进行填充
+            uint64_t maxBytes = MAX_BATCH;
+            if (request->maxbytes() > 0 && request->maxbytes() < maxBytes)
+                maxBytes = request->maxbytes();
+
+            // 先确定每个文件的大小，按请求顺序选出本次返回的文件(至少返回一个文件，保证调用方能够推进)
+            auto files = response->mutable_filedata();
+            std::vector<std::unique_ptr<ReadTask>> tasks;
+            uint64_t total = 0;
             for (int i = 0; i < request->fileidlist_size(); i++)
             {
-                std::string fid = request->fileidlist(i);
-                std::string filename = _storagePath + fid;
-                std::string body;
-                if (!hjb::readFile(filename, body))
+                const std::string &fid = request->fileidlist(i);
+                if (files->count(fid) || response->failedfiles().count(fid))
+                    continue;
+
+                // 缓存命中的文件不需要再读取磁盘
+                butil::IOBuf data;
+                uint64_t size = 0;
+                bool cached = _cache->get(fid, data);
+                if (cached)
                 {
-                    response->set_success(false);
-                    response->set_errmsg("读取文件数据失败");
-                    ERROR("{} 读取文件数据失败", request->requestid());
-                    return;
+                    size = data.size();
+                }
+                else
+                {
+                    struct stat st;
+                    if (stat(_store->path(fid).c_str(), &st) != 0)
+                    {
+                        (*response->mutable_failedfiles())[fid] = "文件不存在";
+                        continue;
+                    }
+                    size = st.st_size;
+                }
+
+                if (total > 0 && total + size > maxBytes)
+                {
+                    response->add_pendingfileids(fid);
+                    continue;
                 }
+                total += size;
 
-                // 获取到文件数据插入映射结构中
-                FileDownloadData data;
-                data.set_fileid(fid);
-                data.set_filecontent(body);
-                response->mutable_filedata()->insert({fid, data});
+                if (cached)
+                {
+                    FileDownloadData &file = (*files)[fid];
+                    file.set_fileid(fid);
+                    data.copy_to(file.mutable_filecontent());
+                }
+                else
+                {
+                    tasks.emplace_back(new ReadTask{this, fid, "", false});
+                }
+            }
+
+            // 并行读取未命中缓存的文件，每次最多同时读取 MAX_PARALLEL 个
+            for (size_t begin = 0; begin < tasks.size(); begin += MAX_PARALLEL)
+            {
+                size_t end = begin + MAX_PARALLEL < tasks.size() ? begin + MAX_PARALLEL : tasks.size();
+                std::vector<bthread_t> tids(end - begin, 0);
+                for (size_t i = begin; i < end; ++i)
+                {
+                    // 无法创建bthread时在当前线程中读取
+                    if (bthread_start_background(&tids[i - begin], nullptr, runReadTask, tasks[i].get()) != 0)
+                    {
+                        tids[i - begin] = 0;
+                        runReadTask(tasks[i].get());
+                    }
+                }
+                for (auto tid : tids)
+                {
+                    if (tid != 0)
+                        bthread_join(tid, nullptr);
+                }
+            }
+
+            for (auto &task : tasks)
+            {
+                if (!task->ok)
+                {
+                    ERROR("{} 读取文件 {} 数据失败", request->requestid(), task->fid);
+                    (*response->mutable_failedfiles())[task->fid] = "读取文件数据失败";
+                    continue;
+                }
+
+                FileDownloadData &file = (*files)[task->fid];
+                file.set_fileid(task->fid);
+                file.mutable_filecontent()->swap(task->body);
             }
             response->set_success(true);
         }
@@ -105,12 +360,9 @@ namespace hjb
 
             response->set_requestid(request->requestid());
 
-            // 为文件生成一个唯一uudi作为文件名以及文件ID
-            std::string fid = hjb::uuid();
-            std::string filename = _storagePath + fid;
-
-            // 取出请求中的文件数据进行文件数据写入
-            if (!hjb::writeFile(filename, request->filedata().filecontent()))
+            // 保存文件数据并生成文件ID，相同内容只保存一份
+            std::string fid = _store->put(request->filedata().filecontent(), FileUploader::ownerSuffix(request->userid()));
+            if (fid.empty())
             {
                 response->set_success(false);
                 response->set_errmsg("写入文件数据失败");
@@ -138,10 +390,8 @@ namespace hjb
 
             for (int i = 0; i < request->filedata_size(); i++)
             {
-                std::string fid = hjb::uuid();
-                std::string filename = _storagePath + fid;
-
-                if (!hjb::writeFile(filename, request->filedata(i).filecontent()))
+                std::string fid = _store->put(request->filedata(i).filecontent(), FileUploader::ownerSuffix(request->userid()));
+                if (fid.empty())
                 {
                     response->set_success(false);
                     response->set_errmsg("写入文件数据失败");
@@ -156,6 +406,370 @@ namespace hjb
             }
             response->set_success(true);
         }
+
+        // 文件分段下载
+        // 数据作为rpc附件返回，单次最多 MAX_RANGE 字节，内存占用与文件大小无关
+        // 可缓存的文件经由热点文件缓存读取，附件直接引用缓存的数据块
+        void GetFileRange(google::protobuf::RpcController *cntl_base,
+                          const ::hjb::GetFileRangeReq *request,
+                          ::hjb::GetFileRangeResp *response,
+                          ::google::protobuf::Closure *done)
+        {
+            // 以 ARII 方式自动释放 done 对象
+            brpc::ClosureGuard rpc_guard(done);
+            brpc::Controller *cntl = static_cast<brpc::Controller *>(cntl_base);
+
+            response->set_requestid(request->requestid());
+
+            // 错误处理函数(出错时调用)
+            auto err = [response](const std::string &errmsg) -> void
+            {
+                response->set_success(false);
+                response->set_errmsg(errmsg);
+            };
+
+            std::string fid = request->fileid();
+            std::string filename = _store->path(fid);
+
+            // 先查缓存，命中时不需要访问磁盘
+            butil::IOBuf cached;
+            bool hit = _cache->get(fid, cached);
+            uint64_t fileSize = cached.size();
+            if (!hit)
+            {
+                struct stat st;
+                if (stat(filename.c_str(), &st) != 0)
+                {
+                    ERROR("{} 获取文件 {} 信息失败：{}", request->requestid(), filename, strerror(errno));
+                    response->set_notfound(errno == ENOENT);
+                    return err("打开文件失败");
+                }
+                fileSize = st.st_size;
+            }
+
+            uint64_t offset = request->offset() < fileSize ? request->offset() : fileSize;
+            uint64_t length = fileSize - offset;
+            if (request->length() > 0 && request->length() < length)
+                length = request->length();
+            if (length > MAX_RANGE)
+                length = MAX_RANGE;
+
+            // 可缓存的小文件(头像等)整个读入缓存，再从中截取所需的范围
+            if (!hit && _cache->cacheable(fileSize))
+            {
+                if (!loadFile(fid, cached) || cached.size() != fileSize)
+                {
+                    ERROR("{} 读取文件 {} 数据失败", request->requestid(), filename);
+                    return err("读取文件数据失败");
+                }
+                hit = true;
+            }
+
+            if (hit)
+            {
+                // 截取的附件与缓存共享数据块，不拷贝数据
+                cached.append_to(&cntl->response_attachment(), length, offset);
+            }
+            else
+            {
+                // 大文件只读取所需的范围，由磁盘读写实现执行(io_uring实现不占用brpc工作线程)
+                std::string body;
+                if (!_io->read(filename, offset, length, body))
+                {
+                    ERROR("{} 读取文件 {} 数据失败", request->requestid(), filename);
+                    return err("读取文件数据失败");
+                }
+                cntl->response_attachment().append(body);
+            }
+
+            response->set_success(true);
+            response->set_filesize(fileSize);
+            response->set_offset(offset);
+            response->set_length(length);
+        }
+
+        // 流式上传
+        // 接受调用方随请求建立的流，文件数据由 UploadStream 边收边写入磁盘
+        void PutFileStream(google::protobuf::RpcController *cntl_base,
+                           const ::hjb::PutFileStreamReq *request,
+                           ::hjb::PutFileStreamResp *response,
+                           ::google::protobuf::Closure *done)
+        {
+            // 以 ARII 方式自动释放 done 对象
+            brpc::ClosureGuard rpc_guard(done);
+            brpc::Controller *cntl = static_cast<brpc::Controller *>(cntl_base);
+
+            response->set_requestid(request->requestid());
+
+            // 错误处理函数(出错时调用)
+            auto err = [response](const std::string &errmsg) -> void
+            {
+                response->set_success(false);
+                response->set_errmsg(errmsg);
+            };
+
+            // 空文件不需要建立流，直接保存
+            std::string fid;
+            if (request->filesize() == 0)
+            {
+                fid = _store->put("", FileUploader::ownerSuffix(request->userid()));
+                if (fid.empty())
+                {
+                    ERROR("{} 保存文件失败", request->requestid());
+                    return err("保存文件失败");
+                }
+            }
+            else
+            {
+                fid = hjb::uuid() + FileUploader::ownerSuffix(request->userid());
+                std::string tmpname = _store->tmpPath();
+                int fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0664);
+                if (fd < 0)
+                {
+                    ERROR("{} 创建文件 {} 失败：{}", request->requestid(), tmpname, strerror(errno));
+                    return err("创建文件失败");
+                }
+
+                auto handler = new UploadStream(_store, _io, fd, tmpname, fid, request->filesize());
+                brpc::StreamOptions options;
+                options.handler = handler;
+                options.idle_timeout_ms = STREAM_IDLE_MS;
+
+                brpc::StreamId sid;
+                if (brpc::StreamAccept(&sid, *cntl, &options) != 0)
+                {
+                    delete handler;
+                    close(fd);
+                    unlink(tmpname.c_str());
+                    ERROR("{} 接受上传流失败", request->requestid());
+                    return err("接受上传流失败");
+                }
+            }
+
+            // 组织响应
+            response->set_success(true);
+            response->mutable_fileinfo()->set_fileid(fid);
+            response->mutable_fileinfo()->set_filesize(request->filesize());
+            response->mutable_fileinfo()->set_filename(request->filename());
+        }
+
+        // 按摘要秒传
+        // 服务端已有相同内容时直接生成新的文件ID，调用方无需再上传文件数据；没有时 exists 为false，调用方照常上传
+        void PutFileByHash(google::protobuf::RpcController *cntl_base,
+                           const ::hjb::PutFileByHashReq *request,
+                           ::hjb::PutFileByHashResp *response,
+                           ::google::protobuf::Closure *done)
+        {
+            // 以 ARII 方式自动释放 done 对象
+            brpc::ClosureGuard rpc_guard(done);
+
+            response->set_requestid(request->requestid());
+
+            if (!BlobStore::validHash(request->sha256()))
+            {
+                response->set_success(false);
+                response->set_errmsg("文件摘要格式错误");
+                return;
+            }
+
+            response->set_success(true);
+            std::string fid = _store->ref(request->sha256(), request->filesize(), FileUploader::ownerSuffix(request->userid()));
+            if (fid.empty())
+            {
+                response->set_exists(false);
+                return;
+            }
+
+            response->set_exists(true);
+            response->mutable_fileinfo()->set_fileid(fid);
+            response->mutable_fileinfo()->set_filesize(request->filesize());
+            response->mutable_fileinfo()->set_filename(request->filename());
+        }
+
+        // 分块上传：开始上传
+        void InitUpload(google::protobuf::RpcController *cntl_base,
+                        const ::hjb::InitUploadReq *request,
+                        ::hjb::InitUploadResp *response,
+                        ::google::protobuf::Closure *done)
+        {
+            // 以 ARII 方式自动释放 done 对象
+            brpc::ClosureGuard rpc_guard(done);
+
+            response->set_requestid(request->requestid());
+
+            // 顺带清理长时间未完成的上传
+            _uploads->sweep();
+
+            // 限制文件大小与每个用户进行中的上传数量，避免未完成的上传占满存储
+            if (request->filesize() > MAX_UPLOAD)
+            {
+                response->set_success(false);
+                response->set_errmsg("文件过大");
+                return;
+            }
+            if (_uploads->pending(request->userid()) >= MAX_PENDING_UPLOADS)
+            {
+                response->set_success(false);
+                response->set_errmsg("进行中的上传过多");
+                return;
+            }
+
+            std::string uploadId = _uploads->create(request->userid(), request->filename(), request->filesize());
+            if (uploadId.empty())
+            {
+                response->set_success(false);
+                response->set_errmsg("创建上传失败");
+                ERROR("{} 创建上传失败", request->requestid());
+                return;
+            }
+
+            response->set_success(true);
+            response->set_uploadid(uploadId);
+            response->set_chunksize(MAX_CHUNK);
+        }
+
+        // 分块上传：上传分块
+        // 分块校验通过后直接追加到数据文件末尾
+        void PutChunk(google::protobuf::RpcController *cntl_base,
+                      const ::hjb::PutChunkReq *request,
+                      ::hjb::PutChunkResp *response,
+                      ::google::protobuf::Closure *done)
+        {
+            // 以 ARII 方式自动释放 done 对象
+            brpc::ClosureGuard rpc_guard(done);
+
+            response->set_requestid(request->requestid());
+
+            // 错误处理函数(出错时调用)
+            auto err = [response](const std::string &errmsg) -> void
+            {
+                response->set_success(false);
+                response->set_errmsg(errmsg);
+            };
+
+            const std::string &data = request->data();
+            if (data.size() > MAX_CHUNK)
+                return err("分块数据过大");
+            if (butil::crc32c::Value(data.data(), data.size()) != request->crc32c())
+                return err("分块数据校验失败");
+
+            auto guard = _uploads->lock(request->uploadid());
+            ChunkUploads::State state;
+            if (!_uploads->load(request->uploadid(), state) || state.userId != request->userid())
+                return err("上传不存在或已过期");
+            response->set_received(state.received);
+
+            // 重传已经接收过的分块：直接返回成功
+            if (request->offset() + data.size() <= state.received)
+            {
+                response->set_success(true);
+                return;
+            }
+            if (request->offset() != state.received)
+                return err("分块偏移与已接收的数据不一致");
+            if (state.received + data.size() > state.fileSize)
+                return err("数据超出声明的文件大小");
+
+            if (!_uploads->append(request->uploadid(), request->offset(), data))
+            {
+                ERROR("{} 写入上传 {} 的分块失败", request->requestid(), request->uploadid());
+                return err("写入分块数据失败");
+            }
+
+            response->set_success(true);
+            response->set_received(state.received + data.size());
+        }
+
+        // 分块上传：查询上传进度
+        void QueryUpload(google::protobuf::RpcController *cntl_base,
+                         const ::hjb::QueryUploadReq *request,
+                         ::hjb::QueryUploadResp *response,
+                         ::google::protobuf::Closure *done)
+        {
+            // 以 ARII 方式自动释放 done 对象
+            brpc::ClosureGuard rpc_guard(done);
+
+            response->set_requestid(request->requestid());
+
+            auto guard = _uploads->lock(request->uploadid());
+            ChunkUploads::State state;
+            if (!_uploads->load(request->uploadid(), state) || state.userId != request->userid())
+            {
+                response->set_success(false);
+                response->set_errmsg("上传不存在或已过期");
+                return;
+            }
+
+            response->set_success(true);
+            response->set_filename(state.fileName);
+            response->set_filesize(state.fileSize);
+            response->set_received(state.received);
+        }
+
+        // 分块上传：提交
+        // 数据文件直接转存到内容存储中，不再拷贝数据
+        void CommitUpload(google::protobuf::RpcController *cntl_base,
+                          const ::hjb::CommitUploadReq *request,
+                          ::hjb::CommitUploadResp *response,
+                          ::google::protobuf::Closure *done)
+        {
+            // 以 ARII 方式自动释放 done 对象
+            brpc::ClosureGuard rpc_guard(done);
+
+            response->set_requestid(request->requestid());
+
+            // 错误处理函数(出错时调用)
+            auto err = [response](const std::string &errmsg) -> void
+            {
+                response->set_success(false);
+                response->set_errmsg(errmsg);
+            };
+
+            // 持锁期间只检查进度并把数据文件移出上传目录，同步与计算摘要不占用上传锁
+            // 移出后该上传即结束，之后对同一上传的请求都返回不存在
+            ChunkUploads::State state;
+            std::string path = _store->tmpPath();
+            {
+                auto guard = _uploads->lock(request->uploadid());
+                if (!_uploads->load(request->uploadid(), state) || state.userId != request->userid())
+                    return err("上传不存在或已过期");
+                if (state.received != state.fileSize)
+                    return err("文件数据尚未上传完整");
+
+                if (rename(_uploads->dataPath(request->uploadid()).c_str(), path.c_str()) != 0)
+                {
+                    ERROR("{} 转移上传 {} 的数据失败：{}", request->requestid(), request->uploadid(), strerror(errno));
+                    return err("保存文件失败");
+                }
+                _uploads->remove(request->uploadid());
+            }
+
+            // 按配置同步到磁盘后转存
+            int fd = open(path.c_str(), O_WRONLY);
+            bool ok = fd >= 0 && _io->flush(fd);
+            if (fd >= 0)
+                close(fd);
+
+            std::string hash = ok ? Sha256::ofFile(path) : "";
+            std::string fid = hjb::uuid() + FileUploader::ownerSuffix(request->userid());
+            if (hash.empty())
+            {
+                unlink(path.c_str());
+                ERROR("{} 保存上传 {} 的文件失败", request->requestid(), request->uploadid());
+                return err("保存文件失败");
+            }
+            if (!_store->commit(path, hash, fid))
+            {
+                ERROR("{} 保存上传 {} 的文件失败", request->requestid(), request->uploadid());
+                return err("保存文件失败");
+            }
+
+            // 组织响应
+            response->set_success(true);
+            response->mutable_fileinfo()->set_fileid(fid);
+            response->mutable_fileinfo()->set_filesize(state.fileSize);
+            response->mutable_fileinfo()->set_filename(state.fileName);
+        }
     };
 
     class FileServer
@@ -188,6 +802,45 @@ namespace hjb
     class FileServerBuild
     {
     public:
+        // 构造磁盘读写模块
+        // backend: stream-标准库文件流  uring-io_uring(需要以 WITH_IO_URING 编译)
+        // durable: 上传的文件是否在返回前同步到磁盘
+        void makeFileIO(const std::string &backend, bool durable,
+                        uint64_t directThreshold = 0, int groupCommitUs = 1000)
+        {
+            if (backend == "stream")
+            {
+                _io = std::make_shared<StreamFileIO>(durable);
+                return;
+            }
+
+#ifdef HJB_IO_URING
+            if (backend == "uring")
+            {
+                UringFileIO::Options options;
+                options.directThreshold = directThreshold;
+                options.groupCommitUs = groupCommitUs;
+                auto io = std::make_shared<UringFileIO>(durable, options);
+                if (!io->ready())
+                {
+                    ERROR("io_uring磁盘读写模块初始化失败");
+                    abort();
+                }
+                _io = io;
+                return;
+            }
+#endif
+
+            ERROR("不支持的磁盘读写实现：{}", backend);
+            abort();
+        }
+
+        // 构造热点文件缓存
+        void makeFileCache(size_t capacity, size_t maxFile)
+        {
+            _cache = std::make_shared<FileCache>(capacity, maxFile);
+        }
+
         // 构造服务注册客户端对象
         void makeRegClient(const std::string &regHost,
                            const std::string &serviceName,
@@ -202,7 +855,18 @@ namespace hjb
         {
             // 添加rpc服务
             _brpcServer = std::make_shared<brpc::Server>();
-            FileServiceImpl *FileService = new FileServiceImpl("./data");
+            if (!_io)
+            {
+                ERROR("未初始化磁盘读写模块");
+                abort();
+            }
+            if (!_cache)
+            {
+                ERROR("未初始化文件缓存模块");
+                abort();
+            }
+
+            FileServiceImpl *FileService = new FileServiceImpl("./data", _io, _cache);
             if (_brpcServer->AddService(FileService, brpc::ServiceOwnership::SERVER_OWNS_SERVICE) == -1)
             {
                 ERROR("添加Rpc服务失败");
@@ -240,5 +904,7 @@ namespace hjb
     private:
         EtcdRegClient::ptr _regClient;
         std::shared_ptr<brpc::Server> _brpcServer;
+        FileIO::ptr _io;
+        FileCache::ptr _cache;
     };
 }
\ No newline at end of file
@@ -0,0 +1,481 @@
+#pragma once
+
+#ifdef HJB_IO_URING
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <condition_variable>
+#include <sys/stat.h>
+#include <liburing.h>
+#include <bthread/countdown_event.h>
+
+#include "fileIO.hpp"
+
+namespace hjb
+{
+    // 基于io_uring的文件读写实现(编译时开启 WITH_IO_URING)
+    // 调用方提交请求后在bthread事件上等待，不占用brpc工作线程；由一个独立线程批量提交请求并收取完成事件
+    // 大文件按分块同时提交读写；超过阈值的文件以O_DIRECT方式读入预先注册的对齐缓冲区，不污染页缓存
+    // 同步到磁盘的请求在一个很短的窗口内攒批后一次提交(组提交)，由文件系统合并日志提交
+    class UringFileIO : public FileIO
+    {
+    public:
+        struct Options
+        {
+            unsigned entries = 256;          // 提交队列长度
+            size_t chunkSize = 1024 * 1024;  // 分块大小，同时也是注册缓冲区的大小
+            int buffers = 16;                // 注册缓冲区的数量
+            uint64_t directThreshold = 0;    // 不小于该大小的文件以O_DIRECT读取，0表示不使用
+            int groupCommitUs = 1000;        // 同步请求的攒批窗口(微秒)
+            size_t groupCommitMax = 64;      // 同步请求攒够该数量时立即提交
+        };
+
+    private:
+        static const size_t ALIGN = 4096; // O_DIRECT要求的对齐大小
+
+        enum Op
+        {
+            READ,
+            READ_FIXED,
+            WRITE,
+            FSYNC
+        };
+
+        struct Request
+        {
+            Op op;
+            int fd = -1;
+            void *buf = nullptr;
+            unsigned len = 0;
+            uint64_t offset = 0;
+            int bufIndex = -1;
+            int result = 0;
+            bthread::CountdownEvent done{1};
+        };
+
+        Options _options;
+        struct io_uring _ring;
+        bool _ready;
+
+        std::mutex _mutex;
+        std::condition_variable _cond;
+        std::vector<Request *> _pending; // 待提交的读写请求
+        std::vector<Request *> _syncs;   // 待组提交的同步请求
+        std::chrono::steady_clock::time_point _firstSync;
+        bool _stop;
+        std::thread _thread;
+
+        std::mutex _bufferMutex;
+        std::vector<char *> _buffers;  // 注册缓冲区
+        std::vector<int> _freeBuffers; // 空闲的注册缓冲区下标
+
+        // 提交线程：取出所有待提交的请求一次提交，再收取已完成的请求
+        void loop()
+        {
+            size_t inflight = 0;
+            std::vector<Request *> batch;
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if (inflight == 0)
+                    {
+                        if (_syncs.empty())
+                            _cond.wait(lock, [this]
+                                       { return _stop || !_pending.empty() || !_syncs.empty(); });
+                        else
+                            _cond.wait_until(lock, _firstSync + std::chrono::microseconds(_options.groupCommitUs), [this]
+                                             { return _stop || !_pending.empty() || _syncs.size() >= _options.groupCommitMax; });
+                    }
+                    if (_stop && inflight == 0 && _pending.empty() && _syncs.empty())
+                        break;
+
+                    batch.swap(_pending);
+                    if (!_syncs.empty() &&
+                        (_stop || _syncs.size() >= _options.groupCommitMax ||
+                         std::chrono::steady_clock::now() >= _firstSync + std::chrono::microseconds(_options.groupCommitUs)))
+                    {
+                        batch.insert(batch.end(), _syncs.begin(), _syncs.end());
+                        _syncs.clear();
+                    }
+                }
+
+                for (auto req : batch)
+                {
+                    struct io_uring_sqe *sqe = io_uring_get_sqe(&_ring);
+                    if (!sqe)
+                    {
+                        // 提交队列已满：先提交已准备好的请求
+                        // 提交失败(例如完成队列溢出时返回-EBUSY)时先收取完成事件再重试
+                        if (io_uring_submit(&_ring) < 0)
+                        {
+                            inflight -= reap();
+                            io_uring_submit(&_ring);
+                        }
+                        sqe = io_uring_get_sqe(&_ring);
+                    }
+                    if (!sqe)
+                    {
+                        // 仍然无法取得提交槽位，该请求直接失败，由调用方改用同步读写
+                        req->result = -EAGAIN;
+                        req->done.signal();
+                        continue;
+                    }
+                    prepare(sqe, req);
+                    ++inflight;
+                }
+                if (!batch.empty())
+                    io_uring_submit(&_ring);
+                batch.clear();
+
+                if (inflight == 0)
+                    continue;
+
+                // 短暂等待完成事件，超时后回到上方取出新提交的请求
+                struct io_uring_cqe *cqe;
+                struct __kernel_timespec ts = {0, 200 * 1000};
+                io_uring_wait_cqe_timeout(&_ring, &cqe, &ts);
+                inflight -= reap();
+            }
+        }
+
+        // 收取所有已完成的请求，返回收取的数量
+        unsigned reap()
+        {
+            struct io_uring_cqe *cqe;
+            unsigned head;
+            unsigned count = 0;
+            io_uring_for_each_cqe(&_ring, head, cqe)
+            {
+                Request *req = static_cast<Request *>(io_uring_cqe_get_data(cqe));
+                req->result = cqe->res;
+                req->done.signal();
+                ++count;
+            }
+            io_uring_cq_advance(&_ring, count);
+            return count;
+        }
+
+        static void prepare(struct io_uring_sqe *sqe, Request *req)
+        {
+            switch (req->op)
+            {
+            case READ:
+                io_uring_prep_read(sqe, req->fd, req->buf, req->len, req->offset);
+                break;
+            case READ_FIXED:
+                io_uring_prep_read_fixed(sqe, req->fd, req->buf, req->len, req->offset, req->bufIndex);
+                break;
+            case WRITE:
+                io_uring_prep_write(sqe, req->fd, req->buf, req->len, req->offset);
+                break;
+            case FSYNC:
+                io_uring_prep_fsync(sqe, req->fd, IORING_FSYNC_DATASYNC);
+                break;
+            }
+            io_uring_sqe_set_data(sqe, req);
+        }
+
+        // 一次性提交一组请求并等待全部完成
+        void submit(const std::vector<Request *> &reqs)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                for (auto req : reqs)
+                {
+                    if (req->op == FSYNC)
+                    {
+                        if (_syncs.empty())
+                            _firstSync = std::chrono::steady_clock::now();
+                        _syncs.push_back(req);
+                    }
+                    else
+                    {
+                        _pending.push_back(req);
+                    }
+                }
+            }
+            _cond.notify_one();
+
+            for (auto req : reqs)
+                req->done.wait();
+        }
+
+        int acquireBuffer()
+        {
+            std::unique_lock<std::mutex> lock(_bufferMutex);
+            if (_freeBuffers.empty())
+                return -1;
+            int index = _freeBuffers.back();
+            _freeBuffers.pop_back();
+            return index;
+        }
+
+        void releaseBuffer(int index)
+        {
+            std::unique_lock<std::mutex> lock(_bufferMutex);
+            _freeBuffers.push_back(index);
+        }
+
+        // 以O_DIRECT方式分块读入注册缓冲区再拷贝到body中，没有空闲缓冲区或文件系统不支持时返回false由调用方改用普通读取
+        bool readDirect(const std::string &path, std::string &body, uint64_t size)
+        {
+            int index = acquireBuffer();
+            if (index < 0)
+                return false;
+
+            int fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+            if (fd < 0)
+            {
+                releaseBuffer(index);
+                return false;
+            }
+
+            bool ok = true;
+            uint64_t offset = 0;
+            while (offset < size)
+            {
+                Request req;
+                req.op = READ_FIXED;
+                req.fd = fd;
+                req.buf = _buffers[index];
+                req.len = _options.chunkSize;
+                req.offset = offset;
+                req.bufIndex = index;
+                submit({&req});
+
+                // 中途的短读会使后续偏移不再对齐，按失败处理
+                if (req.result <= 0 || (offset + req.result < size && req.result % ALIGN != 0))
+                {
+                    ok = false;
+                    break;
+                }
+                uint64_t n = size - offset < (uint64_t)req.result ? size - offset : req.result;
+                memcpy(&body[offset], _buffers[index], n);
+                offset += n;
+            }
+
+            close(fd);
+            releaseBuffer(index);
+            return ok;
+        }
+
+        // 将文件中从offset开始的length字节读入body，所有分块同时提交
+        bool readChunks(int fd, std::string &body, uint64_t offset, uint64_t length)
+        {
+            std::vector<Request> reqs((length + _options.chunkSize - 1) / _options.chunkSize);
+            std::vector<Request *> ptrs;
+            for (size_t i = 0; i < reqs.size(); ++i)
+            {
+                uint64_t begin = i * _options.chunkSize;
+                reqs[i].op = READ;
+                reqs[i].fd = fd;
+                reqs[i].offset = offset + begin;
+                reqs[i].buf = &body[begin];
+                reqs[i].len = length - begin < _options.chunkSize ? length - begin : _options.chunkSize;
+                ptrs.push_back(&reqs[i]);
+            }
+            submit(ptrs);
+
+            bool ok = true;
+            for (auto &req : reqs)
+            {
+                // 未能提交的分块整块同步读取；短读时补读剩余部分
+                if (req.result == -EAGAIN)
+                    req.result = 0;
+                while (ok && req.result >= 0 && (unsigned)req.result < req.len)
+                {
+                    ssize_t n = pread(fd, (char *)req.buf + req.result, req.len - req.result, req.offset + req.result);
+                    if (n <= 0)
+                        ok = false;
+                    else
+                        req.result += n;
+                }
+                if (req.result < 0)
+                    ok = false;
+            }
+            return ok;
+        }
+
+    public:
+        UringFileIO(bool durable, const Options &options)
+            : FileIO(durable), _options(options), _ready(false), _stop(false)
+        {
+            _options.chunkSize = (_options.chunkSize + ALIGN - 1) / ALIGN * ALIGN;
+            int ret = io_uring_queue_init(_options.entries, &_ring, 0);
+            if (ret < 0)
+            {
+                ERROR("初始化io_uring失败：{}", strerror(-ret));
+                return;
+            }
+
+            // 注册缓冲区，供O_DIRECT读取使用
+            if (_options.directThreshold > 0)
+            {
+                std::vector<struct iovec> iovs;
+                for (int i = 0; i < _options.buffers; ++i)
+                {
+                    void *buf = nullptr;
+                    if (posix_memalign(&buf, ALIGN, _options.chunkSize) != 0)
+                        break;
+                    _buffers.push_back(static_cast<char *>(buf));
+                    iovs.push_back({buf, _options.chunkSize});
+                }
+
+                ret = iovs.empty() ? -ENOMEM : io_uring_register_buffers(&_ring, iovs.data(), iovs.size());
+                if (ret < 0)
+                {
+                    WARN("注册io_uring缓冲区失败，不使用O_DIRECT读取：{}", strerror(-ret));
+                    _options.directThreshold = 0;
+                }
+                else
+                {
+                    for (size_t i = 0; i < _buffers.size(); ++i)
+                        _freeBuffers.push_back(i);
+                }
+            }
+
+            _ready = true;
+            _thread = std::thread(&UringFileIO::loop, this);
+        }
+
+        ~UringFileIO()
+        {
+            if (!_ready)
+                return;
+
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _cond.notify_one();
+            _thread.join();
+            io_uring_queue_exit(&_ring);
+            for (auto buf : _buffers)
+                free(buf);
+        }
+
+        // 是否初始化成功(内核不支持io_uring时失败)
+        bool ready() const
+        {
+            return _ready;
+        }
+
+        bool read(const std::string &path, std::string &body) override
+        {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                ERROR("打开文件 {} 失败！", path);
+                return false;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0)
+            {
+                close(fd);
+                ERROR("获取文件 {} 信息失败！", path);
+                return false;
+            }
+
+            uint64_t size = st.st_size;
+            body.resize(size);
+            if (_options.directThreshold > 0 && size >= _options.directThreshold && readDirect(path, body, size))
+            {
+                close(fd);
+                return true;
+            }
+
+            bool ok = readChunks(fd, body, 0, size);
+            close(fd);
+            if (!ok)
+                ERROR("读取文件 {} 数据失败！", path);
+            return ok;
+        }
+
+        bool read(const std::string &path, uint64_t offset, uint64_t length, std::string &body) override
+        {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                ERROR("打开文件 {} 失败！", path);
+                return false;
+            }
+
+            body.resize(length);
+            bool ok = readChunks(fd, body, offset, length);
+            close(fd);
+            if (!ok)
+                ERROR("读取文件 {} 数据失败！", path);
+            return ok;
+        }
+
+        bool write(const std::string &path, const std::string &body) override
+        {
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0664);
+            if (fd < 0)
+            {
+                ERROR("打开文件 {} 失败！", path);
+                return false;
+            }
+
+            std::vector<Request> reqs((body.size() + _options.chunkSize - 1) / _options.chunkSize);
+            std::vector<Request *> ptrs;
+            for (size_t i = 0; i < reqs.size(); ++i)
+            {
+                reqs[i].op = WRITE;
+                reqs[i].fd = fd;
+                reqs[i].offset = i * _options.chunkSize;
+                reqs[i].buf = const_cast<char *>(body.data()) + reqs[i].offset;
+                reqs[i].len = body.size() - reqs[i].offset < _options.chunkSize ? body.size() - reqs[i].offset : _options.chunkSize;
+                ptrs.push_back(&reqs[i]);
+            }
+            submit(ptrs);
+
+            bool ok = true;
+            for (auto &req : reqs)
+            {
+                // 未能提交的分块整块同步写入；短写时补写剩余部分
+                if (req.result == -EAGAIN)
+                    req.result = 0;
+                while (ok && req.result >= 0 && (unsigned)req.result < req.len)
+                {
+                    ssize_t n = pwrite(fd, (char *)req.buf + req.result, req.len - req.result, req.offset + req.result);
+                    if (n <= 0)
+                        ok = false;
+                    else
+                        req.result += n;
+                }
+                if (req.result < 0)
+                    ok = false;
+            }
+
+            if (ok)
+                ok = flush(fd);
+            close(fd);
+            if (!ok)
+                ERROR("写入文件 {} 数据失败！", path);
+            return ok;
+        }
+
+        bool flush(int fd) override
+        {
+            if (!_durable)
+                return true;
+
+            Request req;
+            req.op = FSYNC;
+            req.fd = fd;
+            submit({&req});
+            // 未能提交时同步执行
+            if (req.result == -EAGAIN)
+                return fdatasync(fd) == 0;
+            return req.result == 0;
+        }
+    };
+}
+
+#endif
\ No newline at end of file
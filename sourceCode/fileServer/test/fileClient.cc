@@ -1,12 +1,16 @@
 #include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include <thread>
+#include <brpc/stream.h>
+#include <butil/crc32c.h>
+#include <bthread/countdown_event.h>
 #include "etcd.hpp"
 #include "channel.hpp"
 #include "log.hpp"
 #include "file.pb.h"
 #include "base.pb.h"
 #include "util.hpp"
+#include "sha256.hpp"
 
 DEFINE_bool(runMode, false, "程序的运行模式，false-调试； true-发布；");
 DEFINE_string(logFile, "", "发布模式下指定日志的输出文件");
@@ -140,6 +144,282 @@ TEST(getTest, multiFile)
     hjb::writeFile("file_download", filedata2.filecontent());
 }
 
+TEST(getTest, multiFilePartial)
+{
+    ::hjb::FileService_Stub stub(channel.get());
+
+    // 单次只允许1字节：第一个文件照常返回，第二个文件留到下次请求，不存在的文件单独报告失败
+    ::hjb::GetMultiFileReq req;
+    req.set_requestid("445");
+    req.add_fileidlist(putTestId[0]);
+    req.add_fileidlist("notExistFileId");
+    req.add_fileidlist(putTestId[1]);
+    req.set_maxbytes(1);
+
+    brpc::Controller cntl;
+    ::hjb::GetMultiFileResp resp;
+    stub.GetMultiFile(&cntl, &req, &resp, nullptr);
+    ASSERT_FALSE(cntl.Failed());
+    ASSERT_TRUE(resp.success());
+
+    ASSERT_EQ(resp.filedata().size(), 1);
+    ASSERT_TRUE(resp.filedata().find(putTestId[0]) != resp.filedata().end());
+    ASSERT_TRUE(resp.failedfiles().find("notExistFileId") != resp.failedfiles().end());
+    ASSERT_EQ(resp.pendingfileids_size(), 1);
+    ASSERT_EQ(resp.pendingfileids(0), putTestId[1]);
+}
+
+// 流式上传时接收服务端确认的流处理对象
+class AckHandler : public brpc::StreamInputHandler
+{
+public:
+    bthread::CountdownEvent closed{1};
+    bool acked = false;
+
+    int on_received_messages(brpc::StreamId id, butil::IOBuf *const messages[], size_t size) override
+    {
+        acked = true;
+        return 0;
+    }
+    void on_idle_timeout(brpc::StreamId id) override {}
+    void on_closed(brpc::StreamId id) override { closed.signal(); }
+};
+
+std::string streamFileId;
+std::string streamBody;
+TEST(putTest, streamFile)
+{
+    ASSERT_TRUE(hjb::readFile("./file.pb.cc", streamBody));
+
+    ::hjb::FileService_Stub stub(channel.get());
+    ::hjb::PutFileStreamReq req;
+    req.set_requestid("555");
+    req.set_filename("file.pb.cc");
+    req.set_filesize(streamBody.size());
+
+    // 随请求建立流，请求返回后通过流分块发送文件数据
+    AckHandler ack;
+    brpc::Controller cntl;
+    brpc::StreamId sid;
+    brpc::StreamOptions options;
+    options.handler = &ack;
+    ASSERT_EQ(brpc::StreamCreate(&sid, cntl, &options), 0);
+
+    ::hjb::PutFileStreamResp resp;
+    stub.PutFileStream(&cntl, &req, &resp, nullptr);
+    ASSERT_FALSE(cntl.Failed());
+    ASSERT_TRUE(resp.success());
+
+    const size_t chunk = 4096;
+    for (size_t offset = 0; offset < streamBody.size(); offset += chunk)
+    {
+        butil::IOBuf buf;
+        buf.append(streamBody.data() + offset, std::min(chunk, streamBody.size() - offset));
+        // 对端来不及消费时等待流量控制窗口
+        while (brpc::StreamWrite(sid, buf) == EAGAIN)
+            brpc::StreamWait(sid, nullptr);
+    }
+
+    ack.closed.wait();
+    ASSERT_TRUE(ack.acked);
+    streamFileId = resp.fileinfo().fileid();
+    DEBUG("文件ID：{}", streamFileId);
+}
+
+TEST(getTest, fileRange)
+{
+    ::hjb::FileService_Stub stub(channel.get());
+
+    // 每次只取一小段，验证按偏移循环下载得到的数据与上传的一致
+    std::string body;
+    uint64_t fileSize = 1;
+    while (body.size() < fileSize)
+    {
+        ::hjb::GetFileRangeReq req;
+        req.set_requestid("666");
+        req.set_fileid(streamFileId);
+        req.set_offset(body.size());
+        req.set_length(1000);
+
+        brpc::Controller cntl;
+        ::hjb::GetFileRangeResp resp;
+        stub.GetFileRange(&cntl, &req, &resp, nullptr);
+        ASSERT_FALSE(cntl.Failed());
+        ASSERT_TRUE(resp.success());
+        ASSERT_EQ(resp.offset(), body.size());
+        ASSERT_EQ(resp.length(), cntl.response_attachment().size());
+
+        fileSize = resp.filesize();
+        if (resp.length() == 0)
+            break;
+        body.append(cntl.response_attachment().to_string());
+    }
+
+    ASSERT_EQ(body, streamBody);
+}
+
+TEST(getTest, singleFileAttachment)
+{
+    ::hjb::FileService_Stub stub(channel.get());
+
+    // 以附件返回时数据不放在响应正文中；重复读取命中缓存，结果保持一致
+    for (int i = 0; i < 2; ++i)
+    {
+        ::hjb::GetSingleFileReq req;
+        req.set_requestid("669");
+        req.set_fileid(streamFileId);
+        req.set_attachment(true);
+
+        brpc::Controller cntl;
+        ::hjb::GetSingleFileResp resp;
+        stub.GetSingleFile(&cntl, &req, &resp, nullptr);
+        ASSERT_FALSE(cntl.Failed());
+        ASSERT_TRUE(resp.success());
+        ASSERT_TRUE(resp.filedata().filecontent().empty());
+        ASSERT_EQ(cntl.response_attachment().to_string(), streamBody);
+    }
+}
+
+TEST(putTest, fileByHash)
+{
+    ::hjb::FileService_Stub stub(channel.get());
+
+    // 服务端已有相同内容：不传输数据直接得到新的文件ID
+    ::hjb::PutFileByHashReq req;
+    req.set_requestid("777");
+    req.set_sha256(hjb::Sha256::of(streamBody));
+    req.set_filename("file.pb.cc");
+    req.set_filesize(streamBody.size());
+
+    brpc::Controller cntl;
+    ::hjb::PutFileByHashResp resp;
+    stub.PutFileByHash(&cntl, &req, &resp, nullptr);
+    ASSERT_FALSE(cntl.Failed());
+    ASSERT_TRUE(resp.success());
+    ASSERT_TRUE(resp.exists());
+    ASSERT_NE(resp.fileinfo().fileid(), streamFileId);
+
+    ::hjb::GetSingleFileReq getReq;
+    getReq.set_requestid("778");
+    getReq.set_fileid(resp.fileinfo().fileid());
+    brpc::Controller getCntl;
+    ::hjb::GetSingleFileResp getResp;
+    stub.GetSingleFile(&getCntl, &getReq, &getResp, nullptr);
+    ASSERT_FALSE(getCntl.Failed());
+    ASSERT_TRUE(getResp.success());
+    ASSERT_EQ(getResp.filedata().filecontent(), streamBody);
+
+    // 服务端没有的内容需要照常上传
+    req.set_sha256(hjb::Sha256::of(streamBody + "x"));
+    req.set_filesize(streamBody.size() + 1);
+    brpc::Controller missCntl;
+    ::hjb::PutFileByHashResp missResp;
+    stub.PutFileByHash(&missCntl, &req, &missResp, nullptr);
+    ASSERT_FALSE(missCntl.Failed());
+    ASSERT_TRUE(missResp.success());
+    ASSERT_FALSE(missResp.exists());
+}
+
+TEST(putTest, chunkUpload)
+{
+    std::string body;
+    ASSERT_TRUE(hjb::readFile("./file.pb.cc", body));
+
+    ::hjb::FileService_Stub stub(channel.get());
+
+    ::hjb::InitUploadReq initReq;
+    initReq.set_requestid("888");
+    initReq.set_filename("file.pb.cc");
+    initReq.set_filesize(body.size());
+    brpc::Controller initCntl;
+    ::hjb::InitUploadResp initResp;
+    stub.InitUpload(&initCntl, &initReq, &initResp, nullptr);
+    ASSERT_FALSE(initCntl.Failed());
+    ASSERT_TRUE(initResp.success());
+    std::string uploadId = initResp.uploadid();
+
+    // 上传一个分块
+    auto putChunk = [&](uint64_t offset, size_t len, uint32_t crc) -> ::hjb::PutChunkResp
+    {
+        ::hjb::PutChunkReq req;
+        req.set_requestid("889");
+        req.set_uploadid(uploadId);
+        req.set_offset(offset);
+        req.set_data(body.substr(offset, len));
+        req.set_crc32c(crc);
+        brpc::Controller cntl;
+        ::hjb::PutChunkResp resp;
+        stub.PutChunk(&cntl, &req, &resp, nullptr);
+        EXPECT_FALSE(cntl.Failed());
+        return resp;
+    };
+    const size_t chunk = 10000;
+
+    // 校验值错误的分块被拒绝
+    ASSERT_FALSE(putChunk(0, chunk, 0).success());
+
+    // 只上传前半部分，模拟连接中断
+    size_t half = body.size() / 2;
+    for (size_t offset = 0; offset < half; offset += chunk)
+    {
+        size_t len = std::min(chunk, half - offset);
+        ASSERT_TRUE(putChunk(offset, len, butil::crc32c::Value(body.data() + offset, len)).success());
+    }
+
+    // 查询进度后从已接收的偏移继续上传
+    ::hjb::QueryUploadReq queryReq;
+    queryReq.set_requestid("890");
+    queryReq.set_uploadid(uploadId);
+    brpc::Controller queryCntl;
+    ::hjb::QueryUploadResp queryResp;
+    stub.QueryUpload(&queryCntl, &queryReq, &queryResp, nullptr);
+    ASSERT_FALSE(queryCntl.Failed());
+    ASSERT_TRUE(queryResp.success());
+    ASSERT_EQ(queryResp.received(), half);
+
+    for (size_t offset = queryResp.received(); offset < body.size(); offset += chunk)
+    {
+        size_t len = std::min(chunk, body.size() - offset);
+        ASSERT_TRUE(putChunk(offset, len, butil::crc32c::Value(body.data() + offset, len)).success());
+    }
+
+    ::hjb::CommitUploadReq commitReq;
+    commitReq.set_requestid("891");
+    commitReq.set_uploadid(uploadId);
+    brpc::Controller commitCntl;
+    ::hjb::CommitUploadResp commitResp;
+    stub.CommitUpload(&commitCntl, &commitReq, &commitResp, nullptr);
+    ASSERT_FALSE(commitCntl.Failed());
+    ASSERT_TRUE(commitResp.success());
+    ASSERT_EQ(commitResp.fileinfo().filesize(), body.size());
+
+    ::hjb::GetSingleFileReq getReq;
+    getReq.set_requestid("892");
+    getReq.set_fileid(commitResp.fileinfo().fileid());
+    brpc::Controller getCntl;
+    ::hjb::GetSingleFileResp getResp;
+    stub.GetSingleFile(&getCntl, &getReq, &getResp, nullptr);
+    ASSERT_FALSE(getCntl.Failed());
+    ASSERT_TRUE(getResp.success());
+    ASSERT_EQ(getResp.filedata().filecontent(), body);
+}
+
+TEST(putTest, chunkUploadTooLarge)
+{
+    ::hjb::FileService_Stub stub(channel.get());
+
+    // 超过文件大小上限的上传在开始时被拒绝
+    ::hjb::InitUploadReq req;
+    req.set_requestid("893");
+    req.set_filename("huge");
+    req.set_filesize(1ULL << 40);
+    brpc::Controller cntl;
+    ::hjb::InitUploadResp resp;
+    stub.InitUpload(&cntl, &req, &resp, nullptr);
+    ASSERT_FALSE(cntl.Failed());
+    ASSERT_FALSE(resp.success());
+}
+
 int main(int argc, char *argv[])
 {
     google::ParseCommandLineFlags(&argc, &argv, true);
@@ -19,6 +19,13 @@ DEFINE_string(Mpwd, "111111", "mysql密码");
 DEFINE_string(Mcharset, "utf8", "mysql客户端字符集");
 DEFINE_int32(MmaxPool, 3, "mysql连接池最大连接数");
 
+DEFINE_string(Rhost, "127.0.0.1", "redis服务器地址");
+DEFINE_int32(Rport, 6379, "redis服务器端口");
+DEFINE_int32(Rdb, 0, "redis库的编号");
+DEFINE_bool(RkeepAlive, true, "是否启动长连接保活");
+DEFINE_int32(userCacheSize, 100000, "用户信息本地缓存容量，0表示不开启");
+DEFINE_int32(userCacheTtl, 300, "用户信息本地缓存的存活时长(秒)");
+
 DEFINE_string(Ehost, "http://127.0.0.1:9200/", "es服务器URL");
 
 DEFINE_int32(listenPort, 8100, "Rpc服务器监听端口");
@@ -37,6 +44,9 @@ int main(int argc, char *argv[])
     fssb.makeMysql(FLAGS_Muser, FLAGS_Mpwd, FLAGS_Mhost,
                    FLAGS_Mdb, FLAGS_Mcharset, FLAGS_Mport, FLAGS_MmaxPool);
 
+    fssb.makeRedis(FLAGS_Rhost, FLAGS_Rport, FLAGS_Rdb, FLAGS_RkeepAlive);
+    fssb.makeUserCache(FLAGS_userCacheSize, FLAGS_userCacheTtl);
+
     fssb.makeEtcdDis(FLAGS_registryHost, FLAGS_baseService, FLAGS_userService);
 
     fssb.makeRpcServer(FLAGS_listenPort, FLAGS_rpcTimeout, FLAGS_rpcThreads);
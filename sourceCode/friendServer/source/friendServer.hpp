@@ -9,6 +9,8 @@
 #include "MChatSession.hpp"
 #include "MChatSessionUser.hpp"
 #include "channel.hpp"
+#include "redis.hpp"
+#include "userProfileCache.hpp"
 #include "rabbitMQ.hpp"
 #include "esData.hpp"
 
@@ -30,19 +32,22 @@ namespace hjb
         ChatSessionUserTable::ptr _chatSessionUserMysql;
         ESUser::ptr _es;
         std::string _userServiceName;
+        UserProfileCache::ptr _userCache; // 用户信息获取对象(未开启缓存时直接调用用户子服务)
 
     public:
         FriendServiceImpl(const AllServiceChannel::ptr &channels,
                           const std::shared_ptr<odb::core::database> &mysql,
                           const std::shared_ptr<elasticlient::Client> &es,
-                          const std::string &userServiceName)
+                          const std::string &userServiceName,
+                          const UserProfileCache::ptr &userCache)
             : _channels(channels),
               _friendMysql(std::make_shared<FriendTable>(mysql)),
               _friendApplyMysql(std::make_shared<FriendApplyTable>(mysql)),
               _chatSessionMysql(std::make_shared<ChatSessionTable>(mysql)),
               _chatSessionUserMysql(std::make_shared<ChatSessionUserTable>(mysql)),
               _es(std::make_shared<ESUser>(es)),
-              _userServiceName(userServiceName)
+              _userServiceName(userServiceName),
+              _userCache(userCache)
         {
         }
 
@@ -366,43 +371,12 @@ namespace hjb
         }
 
     private:
+        // 批量获取用户信息，开启缓存时优先从本地缓存获取
         bool _getUser(const std::string &rid,
                       const std::vector<std::string> &userIds,
                       std::unordered_map<std::string, UserProto> &users)
         {
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 获取用户子服务信道失败", rid);
-                return false;
-            }
-
-            GetMultiUserInfoReq req;
-            GetMultiUserInfoResp resp;
-            req.set_requestid(rid);
-            for (auto &id : userIds)
-                req.add_userids(id);
-
-            brpc::Controller cntl;
-            UserService_Stub stub(channel.get());
-            stub.GetMultiUserInfo(&cntl, &req, &resp, nullptr);
-
-            if (cntl.Failed())
-            {
-                ERROR("{} - 用户子服务调用失败: {}", rid, cntl.ErrorText());
-                return false;
-            }
-
-            if (!resp.success())
-            {
-                ERROR("{} - 批量获取用户信息失败: {}", rid, resp.errmsg());
-                return false;
-            }
-
-            for (const auto &user : resp.users())
-                users.insert(std::make_pair(user.first, user.second));
-
-            return true;
+            return _userCache->get(rid, userIds, users);
         }
     };
 
@@ -443,7 +417,7 @@ namespace hjb
         }
     };
 
-    class FriendServerBuild
+    class FriendServerBuild : public UserProfileCacheBuilder
     {
     private:
         std::string _userServiceName;
@@ -481,7 +455,10 @@ namespace hjb
         {
             _userServiceName = userServiceName;
             _channels = std::make_shared<hjb::AllServiceChannel>();
-            _channels->declared(_userServiceName);
+            // 批量获取用户信息是幂等的读接口，开启请求对冲以削减尾延迟
+            ServiceOptions userOptions;
+            userOptions.hedgedMethods = {"GetMultiUserInfo"};
+            _channels->declared(_userServiceName, userOptions);
 
             auto putCb = std::bind(&hjb::AllServiceChannel::onServiceOnline, _channels.get(), std::placeholders::_1, std::placeholders::_2);
             auto delCb = std::bind(&hjb::AllServiceChannel::onServiceOffline, _channels.get(), std::placeholders::_1, std::placeholders::_2);
@@ -520,7 +497,7 @@ namespace hjb
 
             // 添加rpc服务
             _brpcServer = std::make_shared<brpc::Server>();
-            FriendServiceImpl *friendServiceImpl = new FriendServiceImpl(_channels, _mysql, _es, _userServiceName);
+            FriendServiceImpl *friendServiceImpl = new FriendServiceImpl(_channels, _mysql, _es, _userServiceName, buildUserCache(_channels, _userServiceName));
             if (_brpcServer->AddService(friendServiceImpl, brpc::ServiceOwnership::SERVER_OWNS_SERVICE) == -1)
             {
                 ERROR("添加Rpc服务失败");
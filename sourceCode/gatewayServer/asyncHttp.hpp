@@ -0,0 +1,137 @@
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <bthread/bthread.h>
+#include <google/protobuf/stubs/callback.h>
+
+#include "connection.hpp"
+
+namespace hjb
+{
+    // 以std::function包装的rpc完成回调，执行一次后自动释放
+    class RpcCallback : public google::protobuf::Closure
+    {
+    private:
+        std::function<void()> _fn;
+
+    public:
+        RpcCallback(const std::function<void()> &fn) : _fn(fn) {}
+
+        void Run() override
+        {
+            _fn();
+            delete this;
+        }
+    };
+
+    // 在bthread中执行可能阻塞的处理(redis查询、同步rpc调用)，调用方无需等待
+    // bthread创建失败时退化为在当前线程中直接执行
+    inline void runInBthread(std::function<void()> &&fn)
+    {
+        auto task = new std::function<void()>(std::move(fn));
+        bthread_t tid;
+        int ret = bthread_start_background(&tid, nullptr, [](void *arg) -> void *
+                                           {
+            std::unique_ptr<std::function<void()>> task(static_cast<std::function<void()> *>(arg));
+            (*task)();
+            return nullptr; }, task);
+        if (ret != 0)
+        {
+            (*task)();
+            delete task;
+        }
+    }
+
+    // 非阻塞的http服务器
+    // 基于websocketpp的http处理能力实现，与websocket服务器共享同一组io线程
+    // 请求处理函数只负责发起异步rpc，随后立即返回；http响应延迟到rpc完成回调中再发送
+    // 需要访问redis或同步调用子服务的步骤由处理函数交给bthread执行，io线程不等待任何后端，并发能力不再受线程数量限制
+    class AsyncHttpServer
+    {
+    public:
+        using ptr = std::shared_ptr<AsyncHttpServer>;
+        using Handler = std::function<void(const wserver::connection_ptr &)>;
+
+    private:
+        wserver _server;
+        std::unordered_map<std::string, Handler> _routes; // 请求路径与处理函数的映射(只在启动前注册)
+
+    public:
+        AsyncHttpServer(websocketpp::lib::asio::io_service *ios)
+        {
+            _server.set_access_channels(websocketpp::log::alevel::none);
+            _server.clear_error_channels(websocketpp::log::elevel::all);
+            _server.init_asio(ios);
+            _server.set_reuse_addr(true);
+            _server.set_http_handler(std::bind(&AsyncHttpServer::onHttp, this, std::placeholders::_1));
+        }
+
+        // 注册POST请求的处理函数
+        void Post(const std::string &path, const Handler &handler)
+        {
+            _routes[path] = handler;
+        }
+
+        void listen(int port)
+        {
+            _server.listen(port);
+            _server.start_accept();
+        }
+
+        // 发送被延迟的http响应，可以在任意线程中调用
+        // 发送动作投递回io线程执行，rpc回调线程不直接操作连接的socket
+        void reply(const wserver::connection_ptr &conn,
+                   std::string &&body,
+                   const std::string &contentType,
+                   websocketpp::http::status_code::value status = websocketpp::http::status_code::ok)
+        {
+            auto content = std::make_shared<std::string>(std::move(body));
+            _server.get_io_service().post([conn, content, contentType, status]()
+                                          {
+                conn->set_status(status);
+                conn->replace_header("Content-Type", contentType);
+                conn->set_body(*content);
+
+                websocketpp::lib::error_code ec;
+                conn->send_http_response(ec);
+                if (ec)
+                    ERROR("发送http响应失败：{}", ec.message()); });
+        }
+
+    private:
+        void onHttp(websocketpp::connection_hdl hdl)
+        {
+            auto conn = _server.get_con_from_hdl(hdl);
+
+            // 去掉请求路径中的查询参数
+            std::string path = conn->get_resource();
+            auto pos = path.find('?');
+            if (pos != std::string::npos)
+                path.resize(pos);
+
+            auto it = _routes.find(path);
+            if (it == _routes.end())
+            {
+                conn->set_status(websocketpp::http::status_code::not_found);
+                return;
+            }
+            if (conn->get_request().get_method() != "POST")
+            {
+                conn->set_status(websocketpp::http::status_code::method_not_allowed);
+                return;
+            }
+
+            // 声明延迟响应，本函数返回后websocketpp不会自动发送响应
+            websocketpp::lib::error_code ec = conn->defer_http_response();
+            if (ec)
+            {
+                ERROR("http响应延迟设置失败：{}", ec.message());
+                conn->set_status(websocketpp::http::status_code::internal_server_error);
+                return;
+            }
+
+            it->second(conn);
+        }
+    };
+}
@@ -1,49 +1,185 @@
+#pragma once
+
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
+#include <algorithm>
+#include <array>
 #include "log.hpp"
 
 typedef websocketpp::server<websocketpp::config::asio> wserver;
+typedef websocketpp::config::asio::message_type wmessage; // 可在多个连接间共享的websocket消息
 
 namespace hjb
 {
+    // 单个用户在所有设备上的长连接
+    // 常见的手机+电脑两台设备直接存放在内联数组中，超出的部分才使用堆内存
+    class DeviceConnections
+    {
+    private:
+        static const size_t INLINE = 2;
+        wserver::connection_ptr _inline[INLINE];
+        std::vector<wserver::connection_ptr> _overflow;
+        size_t _size;
+
+    public:
+        DeviceConnections() : _size(0) {}
+
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+        const wserver::connection_ptr &operator[](size_t i) const
+        {
+            return i < INLINE ? _inline[i] : _overflow[i - INLINE];
+        }
+
+        void push_back(const wserver::connection_ptr &conn)
+        {
+            if (_size < INLINE)
+                _inline[_size] = conn;
+            else
+                _overflow.push_back(conn);
+            ++_size;
+        }
+
+        // 移除指定连接，用最后一个元素填补空位，不保证顺序
+        bool erase(const wserver::connection_ptr &conn)
+        {
+            for (size_t i = 0; i < _size; ++i)
+            {
+                if ((*this)[i] != conn)
+                    continue;
+
+                wserver::connection_ptr &slot = i < INLINE ? _inline[i] : _overflow[i - INLINE];
+                slot = (*this)[_size - 1];
+                --_size;
+                if (_size >= INLINE)
+                    _overflow.pop_back();
+                else
+                    _inline[_size].reset();
+                return true;
+            }
+
+            return false;
+        }
+    };
+
+    // 长连接管理类
+    // 按用户id和连接地址分别散列到多个分片中，每个分片使用独立的锁，避免所有操作争抢同一把锁
+    // 同一用户可以在多台设备上同时登录，每台设备各自持有一条长连接
     class Connection
     {
     private:
-        std::unordered_map<std::string, wserver::connection_ptr> _uid_connections; // 用户id与websocket连接的关联
-        // 用户的登录会话id和用户id与websocket连接的关联
-        std::unordered_map<wserver::connection_ptr, std::pair<std::string, std::string>> _conns_user;
-        std::mutex _mutex;
+        static const size_t SHARDS = 64; // 分片数量
+
+        // 用户id与websocket连接的关联分片
+        struct UserShard
+        {
+            std::mutex mutex;
+            std::unordered_map<std::string, DeviceConnections> conns;
+        };
+
+        // websocket连接与用户的登录会话id和用户id的关联分片
+        struct ConnShard
+        {
+            std::mutex mutex;
+            std::unordered_map<wserver::connection_ptr, std::pair<std::string, std::string>> users;
+        };
+
+        std::array<UserShard, SHARDS> _userShards;
+        std::array<ConnShard, SHARDS> _connShards;
+
+    private:
+        static size_t userShard(const std::string &uid)
+        {
+            return std::hash<std::string>()(uid) % SHARDS;
+        }
+
+        static size_t connShard(const wserver::connection_ptr &conn)
+        {
+            // 对象地址低位因内存对齐恒为0，先打散再取模
+            size_t addr = (size_t)conn.get();
+            return ((addr >> 4) ^ (addr >> 12)) % SHARDS;
+        }
 
     public:
         using ptr = std::shared_ptr<Connection>;
 
-        Connection(){}
+        Connection() {}
 
         // 新增连接
         void insert(const wserver::connection_ptr &conn,
                     const std::string &uid,
                     const std::string &sid)
         {
-            std::unique_lock<std::mutex> lock(_mutex);
-
-            _uid_connections.insert(std::make_pair(uid, conn));
-            _conns_user.insert(std::make_pair(conn, std::make_pair(uid, sid)));
+            {
+                // 同一条连接重复认证时不重复添加
+                ConnShard &shard = _connShards[connShard(conn)];
+                std::unique_lock<std::mutex> lock(shard.mutex);
+                if (!shard.users.insert(std::make_pair(conn, std::make_pair(uid, sid))).second)
+                    return;
+            }
+            {
+                UserShard &shard = _userShards[userShard(uid)];
+                std::unique_lock<std::mutex> lock(shard.mutex);
+                shard.conns[uid].push_back(conn);
+            }
             DEBUG("长连接建立成功 {}--{}-{}", (size_t)conn.get(), uid, sid);
         }
 
-        // 获取连接
-        wserver::connection_ptr connection(const std::string &uid)
+        // 判断用户是否有任意一台设备在线
+        bool online(const std::string &uid)
+        {
+            UserShard &shard = _userShards[userShard(uid)];
+            std::unique_lock<std::mutex> lock(shard.mutex);
+
+            return shard.conns.find(uid) != shard.conns.end();
+        }
+
+        // 获取用户所有设备的连接
+        void connections(const std::string &uid,
+                         std::vector<wserver::connection_ptr> &conns)
         {
-            std::unique_lock<std::mutex> lock(_mutex);
+            UserShard &shard = _userShards[userShard(uid)];
+            std::unique_lock<std::mutex> lock(shard.mutex);
+
+            auto it = shard.conns.find(uid);
+            if (it == shard.conns.end())
+                return;
 
-            auto it = _uid_connections.find(uid);
-            if (it == _uid_connections.end())
+            for (size_t i = 0; i < it->second.size(); ++i)
+                conns.push_back(it->second[i]);
+        }
+
+        // 批量获取多个用户所有设备的连接，不在线的用户直接跳过
+        // 先按分片归并用户id，每个分片只加一次锁，结果连续存放在同一个数组中
+        void connections(const std::vector<std::string> &uids,
+                         std::vector<wserver::connection_ptr> &conns)
+        {
+            std::vector<std::pair<size_t, const std::string *>> order;
+            order.reserve(uids.size());
+            for (const auto &uid : uids)
+                order.emplace_back(userShard(uid), &uid);
+            std::sort(order.begin(), order.end(),
+                      [](const std::pair<size_t, const std::string *> &a,
+                         const std::pair<size_t, const std::string *> &b)
+                      { return a.first < b.first; });
+
+            conns.reserve(conns.size() + uids.size());
+            size_t i = 0;
+            while (i < order.size())
             {
-                ERROR("未找到 {} 客户端的长连接", uid);
-                return wserver::connection_ptr();
+                UserShard &shard = _userShards[order[i].first];
+                std::unique_lock<std::mutex> lock(shard.mutex);
+                size_t cur = order[i].first;
+                for (; i < order.size() && order[i].first == cur; ++i)
+                {
+                    auto it = shard.conns.find(*order[i].second);
+                    if (it == shard.conns.end())
+                        continue;
+                    for (size_t j = 0; j < it->second.size(); ++j)
+                        conns.push_back(it->second[j]);
+                }
             }
-
-            return _uid_connections[uid];
         }
 
         // 获取客户端的身份信息
@@ -51,10 +187,11 @@ namespace hjb
                     std::string &uid,
                     std::string &sid)
         {
-            std::unique_lock<std::mutex> lock(_mutex);
+            ConnShard &shard = _connShards[connShard(conn)];
+            std::unique_lock<std::mutex> lock(shard.mutex);
 
-            auto it = _conns_user.find(conn);
-            if (it == _conns_user.end())
+            auto it = shard.users.find(conn);
+            if (it == shard.users.end())
             {
                 ERROR("未找到长连接 {} 对应的客户端", (size_t)conn.get());
                 return false;
@@ -66,21 +203,37 @@ namespace hjb
         }
 
         // 移除关联
-        void remove(const wserver::connection_ptr &conn)
+        // 返回该用户是否已经没有任何设备在线
+        bool remove(const wserver::connection_ptr &conn)
         {
-            std::unique_lock<std::mutex> lock(_mutex);
-
-            auto it = _conns_user.find(conn);
-            if (it == _conns_user.end())
+            std::string uid;
             {
-                ERROR("未找到长连接 {} 对应的客户端", (size_t)conn.get());
-                return;
+                ConnShard &shard = _connShards[connShard(conn)];
+                std::unique_lock<std::mutex> lock(shard.mutex);
+
+                auto it = shard.users.find(conn);
+                if (it == shard.users.end())
+                {
+                    ERROR("未找到长连接 {} 对应的客户端", (size_t)conn.get());
+                    return false;
+                }
+
+                uid = it->second.first;
+                shard.users.erase(it);
             }
 
-            std::string uid = it->second.first;
+            UserShard &shard = _userShards[userShard(uid)];
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            auto it = shard.conns.find(uid);
+            if (it == shard.conns.end())
+                return true;
 
-            _conns_user.erase(conn);
-            _uid_connections.erase(uid);
+            it->second.erase(conn);
+            if (!it->second.empty())
+                return false;
+
+            shard.conns.erase(it);
+            return true;
         }
     };
 }
\ No newline at end of file
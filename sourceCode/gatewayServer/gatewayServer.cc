@@ -1,4 +1,5 @@
 #include "gatewayServer.hpp"
+#include <brpc/server.h>
 
 DEFINE_bool(runMode, false, "程序的运行模式，false-调试； true-发布；");
 DEFINE_string(logFile, "", "发布模式下指定日志的输出文件");
@@ -10,6 +11,13 @@ DEFINE_string(accessHost, "127.0.0.1:9000", "当前实例的外部访问地址")
 
 DEFINE_int32(http_port, 8400, "HTTP服务器监听端口");
 DEFINE_int32(websocket_port, 8500, "Websocket服务器监听端口");
+DEFINE_int32(async_http_port, 0, "非阻塞HTTP服务器监听端口，0表示不开启");
+DEFINE_int32(keepAliveInterval, 60, "长连接保活ping间隔(秒)");
+DEFINE_int32(keepAliveTimeout, 180, "长连接超过该时长(秒)无响应则关闭");
+DEFINE_int32(stats_port, 0, "brpc内置监控页面的监听端口(查看各接口的运行统计)，0表示不开启");
+DEFINE_int32(wsThreads, 4, "Websocket服务器的IO线程数量");
+DEFINE_int32(rpcTimeout, 3000, "子服务调用的时间预算(毫秒)");
+DEFINE_int32(mediaRpcTimeout, 10000, "文件与语音子服务调用的时间预算(毫秒)");
 
 DEFINE_string(fileService, "/service/fileService", "文件管理子服务名称");
 DEFINE_string(friendService, "/service/friendService", "好友管理子服务名称");
@@ -22,16 +30,27 @@ DEFINE_string(Rhost, "127.0.0.1", "服务器地址");
 DEFINE_int32(Rport, 6379, "服务器端口");
 DEFINE_int32(Rdb, 0, "库的编号");
 DEFINE_bool(RkeepAlive, true, "是否启动长连接保活");
+DEFINE_int32(RpoolSize, 8, "redis连接池大小");
+DEFINE_int32(sessionTtl, 600, "登录会话的过期时长(秒)，需大于长连接保活间隔且与用户服务保持一致");
+DEFINE_int32(sessionCacheSize, 100000, "登录会话本地缓存容量，0表示不开启");
+DEFINE_int32(sessionCacheTtl, 300, "登录会话本地缓存的存活时长(秒)");
 
 int main(int argc, char *argv[])
 {
     google::ParseCommandLineFlags(&argc, &argv, true);
     hjb::initLogger(FLAGS_runMode, FLAGS_logFile, FLAGS_logLevel);
 
+    // 网关不运行brpc服务器，单独开启内置监控页面以便查看 gateway_* 统计值
+    if (FLAGS_stats_port > 0 && brpc::StartDummyServerAt(FLAGS_stats_port) != 0)
+        WARN("brpc内置监控页面启动失败，端口 {}", FLAGS_stats_port);
+
     hjb::GatewayServerBuilder gsb;
-    gsb.makeRedis(FLAGS_Rhost, FLAGS_Rport, FLAGS_Rdb, FLAGS_RkeepAlive);
+    gsb.makeRedis(FLAGS_Rhost, FLAGS_Rport, FLAGS_Rdb, FLAGS_RkeepAlive, FLAGS_RpoolSize);
+    gsb.makeSessionTtl(FLAGS_sessionTtl);
+    gsb.makeSessionCache(FLAGS_sessionCacheSize, FLAGS_sessionCacheTtl);
+    gsb.makeRpcBudget(FLAGS_rpcTimeout, FLAGS_mediaRpcTimeout);
     gsb.makeEtcdDis(FLAGS_registryHost, FLAGS_baseService, FLAGS_fileService, FLAGS_friendService, FLAGS_messageService, FLAGS_userService, FLAGS_speechService, FLAGS_chatSessionService);
-    gsb.makeServerObject(FLAGS_websocket_port, FLAGS_http_port);
+    gsb.makeServerObject(FLAGS_websocket_port, FLAGS_http_port, FLAGS_async_http_port, FLAGS_keepAliveInterval, FLAGS_keepAliveTimeout, FLAGS_wsThreads);
     auto server = gsb.build();
     server->start();
 }
\ No newline at end of file
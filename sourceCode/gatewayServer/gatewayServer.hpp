@@ -1,4 +1,7 @@
 #include "connection.hpp"
+#include "keepAlive.hpp"
+#include "asyncHttp.hpp"
+#include "routeStats.hpp"
 #include "etcd.hpp"
 #include "redis.hpp"
 #include "channel.hpp"
@@ -20,8 +23,11 @@ namespace hjb
     class GatewayServer
     {
     private:
+        static const uint64_t DOWNLOAD_CHUNK = 1024 * 1024; // 文件下载时每次从文件子服务读取的数据量
+        static const int64_t MIN_DEADLINE_MS = 50;          // 客户端截止时间传给子服务调用时的下限(毫秒)
+
+        std::shared_ptr<sw::redis::Redis> _redis; // redis客户端(用于创建批量操作对象)
         LoginSession::ptr _loginSessionRedis; // 用户redis登录会话操作对象
-        LoginStatus::ptr _statusRedis;        // 用户redis登录状态操作对象
         AllServiceChannel::ptr _channels;     // 用户服务信道操作对象
         std::string _fileServiceName;         // 文件服务的名称
         std::string _userServiceName;         // 用户服务的名称
@@ -31,13 +37,21 @@ namespace hjb
         std::string _chatSessionServiceName;  // 聊天会话服务的名称
         Connection::ptr _connection;          // 连接管理对象
         wserver _wserver;                     // websocket服务器
+        KeepAliveWheel _keepAlive;            // 长连接保活时间轮
+        int _ioThreads;                       // websocket服务器的io线程数量
+        std::chrono::seconds _sessionTtl;     // 登录会话的过期时长
         httplib::Server _httpServer;          // http服务器
         std::thread _httpThread;              // http服务器的执行线程
+        AsyncHttpServer::ptr _asyncHttpServer; // 非阻塞http服务器(未开启时为空)
+        std::vector<RouteStats::ptr> _routeStats; // 所有http接口的运行统计
 
     public:
         using ptr = std::shared_ptr<GatewayServer>;
 
         GatewayServer(const std::shared_ptr<sw::redis::Redis> &redis,
+                      int sessionCacheSize,
+                      int sessionCacheTtl,
+                      int sessionTtl,
                       const AllServiceChannel::ptr &channels,
                       const std::string &fileServiceName,
                       const std::string &messageServiceName,
@@ -47,9 +61,15 @@ namespace hjb
                       const std::string &chatSessionServiceName,
                       int websocketPort,
                       int httpPort,
+                      int asyncHttpPort,
+                      int keepAliveInterval,
+                      int keepAliveTimeout,
+                      int ioThreads,
                       const EtcdDisClient::ptr &disClient)
-            : _loginSessionRedis(std::make_shared<LoginSession>(redis)),
-              _statusRedis(std::make_shared<LoginStatus>(redis)),
+            : _redis(redis),
+              _loginSessionRedis(sessionCacheSize > 0
+                                     ? std::make_shared<LoginSession>(redis, sessionCacheSize, std::chrono::seconds(sessionCacheTtl))
+                                     : std::make_shared<LoginSession>(redis)),
               _channels(channels),
               _fileServiceName(fileServiceName),
               _userServiceName(userServiceName),
@@ -57,7 +77,10 @@ namespace hjb
               _friendServiceName(friendServiceName),
               _speechServiceName(speechServiceName),
               _chatSessionServiceName(chatSessionServiceName),
-              _connection(std::make_shared<Connection>())
+              _connection(std::make_shared<Connection>()),
+              _keepAlive(_wserver, keepAliveInterval, keepAliveTimeout),
+              _ioThreads(ioThreads > 0 ? ioThreads : 1),
+              _sessionTtl(sessionTtl)
         {
             // 搭建websocket服务器
             _wserver.set_access_channels(websocketpp::log::alevel::none);
@@ -65,156 +88,42 @@ namespace hjb
             _wserver.set_open_handler(std::bind(&GatewayServer::onOpen, this, std::placeholders::_1));
             _wserver.set_close_handler(std::bind(&GatewayServer::onClose, this, std::placeholders::_1));
             _wserver.set_message_handler(std::bind(&GatewayServer::onMessage, this, std::placeholders::_1, std::placeholders::_2));
+            _wserver.set_pong_handler(std::bind(&GatewayServer::onPong, this, std::placeholders::_1, std::placeholders::_2));
             _wserver.set_reuse_addr(true);
             _wserver.listen(websocketPort);
             _wserver.start_accept();
+            _keepAlive.setTickCallback(std::bind(&GatewayServer::refreshSessions, this, std::placeholders::_1));
+            _keepAlive.start();
 
             // 搭建http服务器
-            _httpServer.Post("/service/user/getVerifyCode",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::getVerifyCode,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/user/reg",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::reg,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/user/userLogin",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::userLogin,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/user/phoneLogin",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::phoneLogin,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/user/getUserInfo",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::getUserInfo,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/user/setPhoto",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::setPhoto,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/user/setNickname",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::setNickname,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/user/setDesc",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::setDesc,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/user/setPhone",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::setPhone,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/friend/getFriends",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::getFriends,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/friend/addFriend",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::addFriend,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/friend/friendAddProcess",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::friendAddProcess,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/friend/friendRemove",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::friendRemove,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/friend/friendSearch",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::friendSearch,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/friend/getFriendApplys",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::getFriendApplys,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/chatSession/getChatSessions",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::getChatSessions,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/chatSession/createChatSession",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::createChatSession,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/chatSession/getChatSessionUser",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::getChatSessionUser,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/chatSession/newMessage",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::newMessage,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/message/getHistoryMessage",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::getHistoryMessage,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/message/getRecentMsg",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::getRecentMsg,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/message/messageSearch",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::messageSearch,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/file/getSingleFile",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::getSingleFile,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/file/getMultiFile",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::getMultiFile,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/file/putSingleFile",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::putSingleFile,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/file/putMultiFile",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::putMultiFile,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
-            _httpServer.Post("/service/speech/recognition",
-                             (httplib::Server::Handler)std::bind(&GatewayServer::recognition,
-                                                                 this,
-                                                                 std::placeholders::_1,
-                                                                 std::placeholders::_2));
+            // 开启非阻塞http服务器时，两个服务器注册同一张路由表，非阻塞服务器与websocket服务器共用io线程
+            if (asyncHttpPort > 0)
+                _asyncHttpServer = std::make_shared<AsyncHttpServer>(&_wserver.get_io_service());
+            registerRoutes();
 
             _httpThread = std::thread([ this, httpPort](){
                 _httpServer.listen("0.0.0.0", httpPort);
             });
             _httpThread.detach();
+
+            if (_asyncHttpServer)
+                _asyncHttpServer->listen(asyncHttpPort);
         }
 
+        // 启动websocket服务器的io线程池并阻塞等待
+        // 同一连接上的读写、关闭等事件由websocketpp为每个连接创建的strand保证串行执行
+        // 不同连接的事件可以在多个io线程上并行处理
         void start()
         {
+            std::vector<std::thread> threads;
+            for (int i = 1; i < _ioThreads; ++i)
+                threads.emplace_back([this]()
+                                     { _wserver.run(); });
+
             _wserver.run();
+
+            for (auto &t : threads)
+                t.join();
         }
 
     private:
@@ -224,6 +133,7 @@ namespace hjb
             auto resp = std::make_shared<GetUserInfoResp>();
             req.set_requestid(rid);
             req.set_userid(uid);
+            req.set_photobyref(true); // 推送中只携带头像文件id，客户端按需获取头像
 
             // 将请求转发给用户子服务进行业务处理
             auto channel = _channels->choose(_userServiceName);
@@ -245,6 +155,163 @@ namespace hjb
             return resp;
         }
 
+        // 将同一条通知推送给多个用户的所有在线设备
+        // 消息只序列化一次，所有接收者共享同一份只读的消息缓冲区
+        // 查找连接和发送都投递到websocket服务器的io线程中执行，调用方无需等待
+        // 大群的接收者按批拆分后分别投递，由io线程池并行推送
+        void transmit(std::vector<std::string> &&uids, const WebsocketMessage &web)
+        {
+            static const size_t BATCH = 256; // 每个推送任务负责的接收者数量
+
+            if (uids.empty())
+                return;
+
+            auto msg = std::make_shared<wmessage>(wmessage::con_msg_man_ptr(),
+                                                  websocketpp::frame::opcode::value::binary);
+            msg->set_payload(web.SerializeAsString());
+
+            for (size_t begin = 0; begin < uids.size(); begin += BATCH)
+            {
+                size_t end = std::min(uids.size(), begin + BATCH);
+                auto targets = std::make_shared<std::vector<std::string>>(
+                    std::make_move_iterator(uids.begin() + begin),
+                    std::make_move_iterator(uids.begin() + end));
+                _wserver.get_io_service().post([this, targets, msg]()
+                                               {
+                    std::vector<wserver::connection_ptr> conns;
+                    _connection->connections(*targets, conns);
+                    for (auto &conn : conns)
+                        conn->send(msg); });
+            }
+        }
+
+        // 好友申请成功后，若被申请人在线则推送申请通知
+        // 返回false表示获取申请人信息失败
+        bool notifyFriendAdd(const FriendAddReq &req)
+        {
+            if (!_connection->online(req.friendid()))
+                return true;
+
+            auto user = _GetUserInfo(req.requestid(), req.userid());
+            if (!user)
+            {
+                ERROR("{} 获取当前客户端用户信息失败！", req.requestid());
+                return false;
+            }
+
+            WebsocketMessage web;
+            web.set_type(WebsocketType::FRIEND_ADD_APPLY);
+            web.mutable_friendaddapply()->mutable_userinfo()->CopyFrom(user->user());
+            transmit({req.friendid()}, web);
+            return true;
+        }
+
+        // 好友申请处理完成后，通知申请人处理结果
+        // 若是同意则为双方推送新建的单聊会话
+        bool notifyFriendAddProcess(const FriendAddProcessReq &req, const FriendAddProcessResp &resp)
+        {
+            // 获取双方的用户信息
+            auto user = _GetUserInfo(req.requestid(), req.userid());
+            if (!user)
+            {
+                ERROR("{} 获取当前客户端用户信息失败！", req.requestid());
+                return false;
+            }
+            auto friendInfo = _GetUserInfo(req.requestid(), req.applyuserid());
+            if (!friendInfo)
+            {
+                ERROR("{} 获取当前客户端用户信息失败！", req.requestid());
+                return false;
+            }
+
+            // 通知对方
+            {
+                WebsocketMessage web;
+                web.set_type(WebsocketType::FRIEND_ADD_PROCESS);
+                auto res = web.mutable_friendprocessresult();
+                res->mutable_userinfo()->CopyFrom(friendInfo->user());
+                res->set_agree(req.agree());
+                transmit({req.applyuserid()}, web);
+            }
+            // 给对方创建聊天会话
+            if (req.agree())
+            {
+                WebsocketMessage web;
+                web.set_type(WebsocketType::CHAT_SESSION_CREATE);
+                auto session = web.mutable_newchatsessioninfo();
+                session->mutable_chatsessioninfo()->set_singlechatfriendid(req.userid());
+                session->mutable_chatsessioninfo()->set_chatsessionid(resp.newchatsessionid());
+                session->mutable_chatsessioninfo()->set_chatsessionname(user->user().nickname());
+                session->mutable_chatsessioninfo()->set_photoid(user->user().photoid());
+                transmit({req.applyuserid()}, web);
+            }
+            // 给自己创建聊天会话
+            if (req.agree())
+            {
+                WebsocketMessage web;
+                web.set_type(WebsocketType::CHAT_SESSION_CREATE);
+                auto session = web.mutable_newchatsessioninfo();
+                session->mutable_chatsessioninfo()->set_singlechatfriendid(req.applyuserid());
+                session->mutable_chatsessioninfo()->set_chatsessionid(resp.newchatsessionid());
+                session->mutable_chatsessioninfo()->set_chatsessionname(friendInfo->user().nickname());
+                session->mutable_chatsessioninfo()->set_photoid(friendInfo->user().photoid());
+                transmit({req.userid()}, web);
+            }
+            return true;
+        }
+
+        // 好友删除成功后通知对方
+        void notifyFriendRemove(const FriendRemoveReq &req, const std::string &uid)
+        {
+            WebsocketMessage web;
+            web.set_type(WebsocketType::FRIEND_REMOVE);
+            web.mutable_friendremove()->set_userid(uid);
+            transmit({req.friendid()}, web);
+        }
+
+        // 聊天会话创建成功后通知所有会话成员
+        void notifyChatSessionCreate(const ChatSessionCreateReq &req, const ChatSessionCreateResp &resp)
+        {
+            WebsocketMessage web;
+            web.set_type(WebsocketType::CHAT_SESSION_CREATE);
+            auto session = web.mutable_newchatsessioninfo();
+            session->mutable_chatsessioninfo()->CopyFrom(resp.chatsessioninfo());
+            transmit(std::vector<std::string>(req.userids().begin(), req.userids().end()), web);
+        }
+
+        // 为保活时间轮当前刻度上的存活连接续期登录会话
+        // 每条连接每个保活间隔只续期一次，同一刻度的所有续期合并为一次往返，不随请求量增加redis写入
+        // 该回调运行在websocket的io线程上，只在此收集uid与sid，redis往返交给bthread执行，避免阻塞同线程的其他连接
+        void refreshSessions(const std::vector<wserver::connection_ptr> &conns)
+        {
+            std::vector<std::string> sids;
+            sids.reserve(conns.size());
+            std::string uid, sid;
+            for (auto &conn : conns)
+            {
+                if (!_connection->client(conn, uid, sid))
+                    continue;
+                sids.push_back(sid);
+            }
+            if (sids.empty())
+                return;
+
+            runInBthread([this, sids = std::move(sids)]()
+                         {
+                auto pipe = _redis->pipeline(false);
+                for (auto &sid : sids)
+                    _loginSessionRedis->expire(pipe, sid, _sessionTtl);
+
+                try
+                {
+                    pipe.exec();
+                }
+                catch (const sw::redis::Error &e)
+                {
+                    ERROR("登录会话续期失败：{}", e.what());
+                } });
+        }
+
         void onOpen(websocketpp::connection_hdl hdl)
         {
             DEBUG("websocket长连接建立成功");
@@ -259,31 +326,38 @@ namespace hjb
                 WARN("长连接断开时未找到长连接对应的客户端信息");
                 return;
             }
-            // 移除登录会话
-            _loginSessionRedis->remove(sid);
-            // 移除登录状态
-            _statusRedis->remove(uid);
             // 移除长连接管理
+            _keepAlive.remove(conn);
             _connection->remove(conn);
+            // 移除该设备的登录会话，用户的其他设备不受影响
+            // 与续期相同，redis往返交给bthread执行，避免阻塞同一io线程上的其他连接
+            runInBthread([this, sid, uid]()
+                         {
+                auto pipe = _redis->pipeline(false);
+                _loginSessionRedis->remove(pipe, sid);
+
+                try
+                {
+                    pipe.exec();
+                }
+                catch (const sw::redis::Error &e)
+                {
+                    ERROR("{} {} 长连接断开时清理登录会话失败：{}", sid, uid, e.what());
+                } });
 
             DEBUG("{} {} {} 长连接断开成功清理缓存数据", sid, uid, (size_t)conn.get());
         }
 
-        void keepAlive(wserver::connection_ptr conn)
+        void onPong(websocketpp::connection_hdl hdl, std::string payload)
         {
-            if (!conn || conn->get_state() != websocketpp::session::state::value::open)
-            {
-                DEBUG("非正常连接状态，结束连接保活");
-                return;
-            }
-
-            conn->ping("");
-            _wserver.set_timer(60000, std::bind(&GatewayServer::keepAlive, this, conn));
+            _keepAlive.touch(_wserver.get_con_from_hdl(hdl));
         }
 
         void onMessage(websocketpp::connection_hdl hdl, wserver::message_ptr msg)
         {
             auto conn = _wserver.get_con_from_hdl(hdl);
+            // 已加入保活管理的连接收到任意消息都视为活跃
+            _keepAlive.touch(conn);
 
             // 针对消息内容进行反序列化
             ClientAuthenticationReq req;
@@ -307,1483 +381,540 @@ namespace hjb
             // 添加长连接管理
             _connection->insert(conn, *uid, sid);
             DEBUG("新增长连接管理：{}-{}-{}", sid, *uid, (size_t)conn.get());
-            keepAlive(conn);
+            _keepAlive.insert(conn);
         }
 
-        void getVerifyCode(const httplib::Request &request, httplib::Response &response)
+        // 一次转发调用的上下文
+        template <typename Req, typename Resp>
+        struct RouteCall
         {
-            // 取出http请求正文，将正文进行反序列化
-            PhoneVerifyCodeReq req;
-            PhoneVerifyCodeResp resp;
+            using Auth = std::function<bool(Req &)>;                                // 鉴权函数，为空表示该接口不需要鉴权
+            using After = std::function<bool(RouteCall &)>;                         // 子服务调用成功后、生成响应前的附加处理
+            using Render = std::function<std::string(RouteCall &, const std::string &)>; // 生成http响应正文，为空时直接序列化子服务的响应
 
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
+            Req req;
+            Resp resp;
+            brpc::Controller cntl;
+            ServiceChannel::ChannelPtr channel; // 持有信道直到调用结束，避免节点下线时信道被提前释放
+            bool clientError = false;           // 失败原因是否在客户端(请求正文无效、鉴权失败、已超过截止时间)
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        };
+
+        // 路由描述
+        // 由请求、响应和子服务接口的类型确定整个转发流程：解析正文->鉴权->选择子服务节点->调用->序列化响应
+        template <typename Stub, typename Req, typename Resp>
+        struct Route
+        {
+            using Call = RouteCall<Req, Resp>;
+            using Method = void (Stub::*)(google::protobuf::RpcController *, const Req *, Resp *, google::protobuf::Closure *);
+            using Key = std::function<std::string(const Req &)>; // 一致性哈希的键，为空时按负载均衡策略选择节点
+
+            std::string path;        // 接口路径
+            std::string serviceName; // 子服务名称
+            Method method;           // 子服务接口
+            typename Call::Auth auth;
+            typename Call::After after;
+            typename Call::Render render;
+            Key key;
+            bool retry = true;     // 调用失败时是否允许重试，非幂等的写接口需要关闭
+            RouteStats::ptr stats; // 接口的运行统计
+        };
+
+        // 根据请求中的登录会话id完成身份识别，并将用户id填入请求
+        template <typename Req>
+        std::function<bool(Req &)> sessionAuth(const std::string &(Req::*sid)() const)
+        {
+            return [this, sid](Req &req) -> bool
             {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
+                auto uid = _loginSessionRedis->uid((req.*sid)());
+                if (!uid)
+                {
+                    ERROR("获取登录会话关联用户信息失败 {}", (req.*sid)());
+                    return false;
+                }
+                req.set_userid(*uid);
+                return true;
             };
+        }
 
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("获取短信验证码请求正文反序列化失败");
-                return err("获取短信验证码请求正文反序列化失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到用户管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到用户管理子服务节点");
-            }
+        // 一致性哈希的键：同一聊天会话的请求落到同一个子服务节点
+        template <typename Req>
+        static std::string chatSessionKey(const Req &req)
+        {
+            return req.chatsessionid();
+        }
 
-            UserService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetPhoneVerifyCode(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 用户子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("用户子服务调用失败");
-            }
+        // 一致性哈希的键：同一用户的请求落到同一个子服务节点(鉴权后用户id才会被填入)
+        template <typename Req>
+        static std::string userKey(const Req &req)
+        {
+            return req.userid();
+        }
 
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
+        // 注册一条路由，同时生成阻塞式和非阻塞式两种处理函数
+        // 返回路由描述，注册后仍可设置其余可选项(例如一致性哈希的键)
+        template <typename Stub, typename Req, typename Resp>
+        std::shared_ptr<Route<Stub, Req, Resp>> route(const std::string &path,
+                   const std::string &serviceName,
+                   void (Stub::*method)(google::protobuf::RpcController *, const Req *, Resp *, google::protobuf::Closure *),
+                   const typename RouteCall<Req, Resp>::Auth &auth,
+                   const typename RouteCall<Req, Resp>::After &after = nullptr,
+                   const typename RouteCall<Req, Resp>::Render &render = nullptr)
+        {
+            auto r = std::make_shared<Route<Stub, Req, Resp>>();
+            r->path = path;
+            r->serviceName = serviceName;
+            r->method = method;
+            r->auth = auth;
+            r->after = after;
+            r->render = render;
+            r->stats = std::make_shared<RouteStats>(path);
+            _routeStats.push_back(r->stats);
+
+            _httpServer.Post(path, [this, r](const httplib::Request &request, httplib::Response &response)
+                             { syncForward(*r, request.body, request.get_header_value(deadlineHeader()), response); });
+            if (_asyncHttpServer)
+                _asyncHttpServer->Post(path, [this, r](const wserver::connection_ptr &conn)
+                                       { asyncForward(r, conn); });
+            return r;
         }
 
-        void reg(const httplib::Request &request, httplib::Response &response)
+        // 客户端携带请求截止时间的请求头，值为剩余的毫秒数
+        static std::string deadlineHeader()
         {
-            // 取出http请求正文，将正文进行反序列化
-            UserRegReq req;
-            UserRegResp resp;
+            return "X-Timeout-Ms";
+        }
 
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
+        // 解析请求正文、鉴权并选择子服务节点
+        // 返回错误信息，成功时返回空串
+        // deadline: 客户端通过请求头携带的剩余时间(毫秒)，为空时使用子服务的时间预算
+        template <typename Stub, typename Req, typename Resp>
+        std::string prepare(const Route<Stub, Req, Resp> &route, RouteCall<Req, Resp> &call, const std::string &body, const std::string &deadline)
+        {
+            if (!call.req.ParseFromString(body))
             {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-               resp.set_success(false);
-                resp.set_errmsg(errmsg);
-            };
+                ERROR("{} 请求正文反序列化失败", route.path);
+                call.clientError = true;
+                return "请求正文反序列化失败";
+            }
 
-            if (!req.ParseFromString(request.body))
+            // 客户端身份识别与鉴权
+            if (route.auth && !route.auth(call.req))
             {
-                ERROR("注册用户请求正文反序列化失败");
-                return err("注册用户请求正文反序列化失败");
+                call.clientError = true;
+                return "获取登录会话关联用户信息失败";
             }
 
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
+            call.channel = route.key ? _channels->choose(route.serviceName, route.key(call.req))
+                                     : _channels->choose(route.serviceName);
+            if (!call.channel)
             {
-                ERROR("{} - 未找到用户管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到用户管理子服务节点");
+                ERROR("{} - 未找到子服务节点 - {}", call.req.requestid(), route.serviceName);
+                return "未找到子服务节点";
             }
+            if (!route.retry)
+                call.cntl.set_max_retry(0);
 
-            UserService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.UserRegister(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
+            // 客户端的截止时间扣除网关已经耗费的时间后传给子服务调用，只允许缩短子服务的时间预算
+            if (!deadline.empty())
             {
-                ERROR("{} - 用户子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("用户子服务调用失败");
+                int64_t remain = std::atoll(deadline.c_str()) -
+                                 std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - call.start).count();
+                if (remain <= 0)
+                {
+                    ERROR("{} - {} 请求已超过截止时间", call.req.requestid(), route.path);
+                    call.clientError = true;
+                    return "请求已超时";
+                }
+
+                // 过短的截止时间按下限处理，避免子服务调用几乎必然超时
+                if (remain < MIN_DEADLINE_MS)
+                    remain = MIN_DEADLINE_MS;
+
+                int budget = call.channel->options().timeout_ms;
+                if (budget < 0 || remain < budget)
+                    call.cntl.set_timeout_ms(remain);
             }
 
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
+            return "";
         }
 
-        void userLogin(const httplib::Request &request, httplib::Response &response)
+        // 检查子服务的调用结果并执行附加处理
+        // 返回错误信息，成功时返回空串
+        template <typename Stub, typename Req, typename Resp>
+        std::string finish(const Route<Stub, Req, Resp> &route, RouteCall<Req, Resp> &call)
         {
-            // 取出http请求正文，将正文进行反序列化
-            UserLoginReq req;
-            UserLoginResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("用户账号登录请求正文反序列化失败");
-                return err("用户账号登录请求正文反序列化失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
+            if (call.cntl.Failed() || !call.resp.success())
             {
-                ERROR("{} - 未找到用户管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到用户管理子服务节点");
+                ERROR("{} - {} 子服务调用失败：{}", call.req.requestid(), route.path, call.cntl.ErrorText());
+                return "子服务调用失败";
             }
 
-            UserService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.UserLogin(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 用户子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("用户子服务调用失败");
-            }
+            if (route.after && !route.after(call))
+                return "获取当前客户端用户信息失败";
 
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
+            return "";
         }
 
-        void phoneLogin(const httplib::Request &request, httplib::Response &response)
+        // 生成http响应正文并记录接口统计
+        template <typename Stub, typename Req, typename Resp>
+        std::string render(const Route<Stub, Req, Resp> &route, RouteCall<Req, Resp> &call, const std::string &errmsg)
         {
-            // 取出http请求正文，将正文进行反序列化
-            PhoneLoginReq req;
-            PhoneLoginResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
+            route.stats->record(call.start, errmsg.empty(), call.clientError);
 
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("用户手机登录请求正文反序列化失败");
-                return err("用户手机登录请求正文反序列化失败");
-            }
+            if (route.render)
+                return route.render(call, errmsg);
 
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
+            if (!errmsg.empty())
             {
-                ERROR("{} - 未找到用户管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到用户管理子服务节点");
+                call.resp.set_requestid(call.req.requestid());
+                call.resp.set_success(false);
+                call.resp.set_errmsg(errmsg);
             }
+            return call.resp.SerializeAsString();
+        }
 
-            UserService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.PhoneLogin(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
+        // 阻塞式转发：在httplib的工作线程中同步等待子服务响应
+        template <typename Stub, typename Req, typename Resp>
+        void syncForward(const Route<Stub, Req, Resp> &route, const std::string &body, const std::string &deadline, httplib::Response &response)
+        {
+            RouteCall<Req, Resp> call;
+            std::string errmsg = prepare(route, call, body, deadline);
+            if (errmsg.empty())
             {
-                ERROR("{} - 用户子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("用户子服务调用失败");
+                Stub stub(call.channel.get());
+                (stub.*route.method)(&call.cntl, &call.req, &call.resp, nullptr);
+                errmsg = finish(route, call);
             }
 
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
+            response.set_content(render(route, call, errmsg), "application/x-protbuf");
         }
 
-        void getUserInfo(const httplib::Request &request, httplib::Response &response)
+        // 非阻塞转发：io线程只负责发起异步rpc，随后立即返回处理下一个请求
+        // 鉴权需要查询redis(本地缓存未命中时)，因此需要鉴权的接口在bthread中完成鉴权并发起rpc
+        // 附加处理中的推送需要同步调用用户子服务，同样交给bthread执行，不占用rpc完成回调
+        // 子服务的响应序列化后作为http响应发送，发送动作由AsyncHttpServer投递回io线程
+        template <typename Stub, typename Req, typename Resp>
+        void asyncForward(const std::shared_ptr<Route<Stub, Req, Resp>> &route, const wserver::connection_ptr &conn)
         {
-            // 取出http请求正文，将正文进行反序列化
-            GetUserInfoReq req;
-            GetUserInfoResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
+            auto call = std::make_shared<RouteCall<Req, Resp>>();
+            auto body = std::make_shared<std::string>(conn->get_request_body());
+            std::string deadline = conn->get_request_header(deadlineHeader());
+
+            auto start = [this, route, call, conn, body, deadline]()
+            {
+                std::string errmsg = prepare(*route, *call, *body, deadline);
+                if (!errmsg.empty())
+                    return _asyncHttpServer->reply(conn, render(*route, *call, errmsg), "application/x-protbuf");
+
+                Stub stub(call->channel.get());
+                (stub.*route->method)(&call->cntl, &call->req, &call->resp, new RpcCallback([this, route, call, conn]()
+                                                                                             {
+                    auto done = [this, route, call, conn]()
+                    {
+                        std::string errmsg = finish(*route, *call);
+                        _asyncHttpServer->reply(conn, render(*route, *call, errmsg), "application/x-protbuf");
+                    };
+                    if (route->after)
+                        runInBthread(done);
+                    else
+                        done(); }));
             };
 
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("获取用户信息请求正文反序列化失败");
-                return err("获取用户信息请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-            req.set_userid(*uid);
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到用户管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到用户管理子服务节点");
-            }
+            if (route->auth)
+                runInBthread(start);
+            else
+                start();
+        }
 
-            UserService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetUserInfo(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
+        // 新消息转发成功后，将消息推送给聊天会话中除自己以外的所有成员
+        // 推送交给websocket的io线程异步完成，http响应不等待推送结束
+        bool transmitNewMessage(RouteCall<NewMessageReq, GetTransmitTargetResp> &call)
+        {
+            std::vector<std::string> targets;
+            targets.reserve(call.resp.targetids_size());
+            for (int i = 0; i < call.resp.targetids_size(); ++i)
             {
-                ERROR("{} - 用户子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("用户子服务调用失败：");
+                if (call.resp.targetids(i) == call.req.userid())
+                    continue;
+                targets.push_back(call.resp.targetids(i));
             }
 
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
+            WebsocketMessage web;
+            web.set_type(WebsocketType::CHAT_MESSAGE);
+            web.mutable_newmessageinfo()->mutable_messageinfo()->Swap(call.resp.mutable_message());
+            transmit(std::move(targets), web);
+            return true;
         }
 
-        void setPhoto(const httplib::Request &request, httplib::Response &response)
+        // 路由表
+        void registerRoutes()
         {
-            // 取出http请求正文，将正文进行反序列化
-            SetUserPhotoReq req;
-            SetUserPhotoResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("设置用户头像请求正文反序列化失败");
-                return err("设置用户头像请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-            req.set_userid(*uid);
+            // 用户管理
+            route("/service/user/getVerifyCode", _userServiceName, &UserService_Stub::GetPhoneVerifyCode, nullptr);
+            route("/service/user/reg", _userServiceName, &UserService_Stub::UserRegister, nullptr);
+            route("/service/user/userLogin", _userServiceName, &UserService_Stub::UserLogin, nullptr);
+            route("/service/user/phoneLogin", _userServiceName, &UserService_Stub::PhoneLogin, nullptr);
+            route("/service/user/getUserInfo", _userServiceName, &UserService_Stub::GetUserInfo, sessionAuth(&GetUserInfoReq::loginsessionid));
+            route("/service/user/setPhoto", _userServiceName, &UserService_Stub::SetUserPhoto, sessionAuth(&SetUserPhotoReq::loginsessionid));
+            route("/service/user/setNickname", _userServiceName, &UserService_Stub::SetUserNickname, sessionAuth(&SetNicknameReq::loginsessionid));
+            route("/service/user/setDesc", _userServiceName, &UserService_Stub::SetUserDescription, sessionAuth(&SetUserDescReq::loginsessionid));
+            route("/service/user/setPhone", _userServiceName, &UserService_Stub::SetUserPhoneNumber, sessionAuth(&SetPhoneReq::loginsessionid));
+
+            // 好友管理
+            route("/service/friend/getFriends", _friendServiceName, &FriendService_Stub::GetFriendList, sessionAuth(&GetFriendListReq::loginsessionid));
+            route("/service/friend/addFriend", _friendServiceName, &FriendService_Stub::FriendAdd, sessionAuth(&FriendAddReq::loginsessionid),
+                  [this](RouteCall<FriendAddReq, FriendAddResp> &call)
+                  { return notifyFriendAdd(call.req); });
+            route("/service/friend/friendAddProcess", _friendServiceName, &FriendService_Stub::FriendAddProcess, sessionAuth(&FriendAddProcessReq::loginsessionid),
+                  [this](RouteCall<FriendAddProcessReq, FriendAddProcessResp> &call)
+                  { return notifyFriendAddProcess(call.req, call.resp); });
+            route("/service/friend/friendRemove", _friendServiceName, &FriendService_Stub::FriendRemove, sessionAuth(&FriendRemoveReq::loginsessionid),
+                  [this](RouteCall<FriendRemoveReq, FriendRemoveResp> &call)
+                  { notifyFriendRemove(call.req, call.req.userid()); return true; });
+            route("/service/friend/friendSearch", _friendServiceName, &FriendService_Stub::FriendSearch, sessionAuth(&FriendSearchReq::loginsessionid));
+            route("/service/friend/getFriendApplys", _friendServiceName, &FriendService_Stub::GetPendingFriendEventList, sessionAuth(&GetPendingFriendEventListReq::loginsessionid));
+
+            // 聊天会话管理(按聊天会话或用户做一致性哈希，便于子服务节点缓存热点会话)
+            route("/service/chatSession/getChatSessions", _chatSessionServiceName, &ChatSessionService_Stub::GetChatSessionList, sessionAuth(&GetChatSessionListReq::loginsessionid))->key = userKey<GetChatSessionListReq>;
+            route("/service/chatSession/createChatSession", _chatSessionServiceName, &ChatSessionService_Stub::ChatSessionCreate, sessionAuth(&ChatSessionCreateReq::loginsessionid),
+                  [this](RouteCall<ChatSessionCreateReq, ChatSessionCreateResp> &call)
+                  { notifyChatSessionCreate(call.req, call.resp); call.resp.clear_chatsessioninfo(); return true; });
+            route("/service/chatSession/getChatSessionUser", _chatSessionServiceName, &ChatSessionService_Stub::GetChatSessionMember, sessionAuth(&GetChatSessionMemberReq::loginsessionid))->key = chatSessionKey<GetChatSessionMemberReq>;
+            route("/service/chatSession/newMessage", _chatSessionServiceName, &ChatSessionService_Stub::GetTransmitTarget, sessionAuth(&NewMessageReq::loginsessionid),
+                  std::bind(&GatewayServer::transmitNewMessage, this, std::placeholders::_1),
+                  [](RouteCall<NewMessageReq, GetTransmitTargetResp> &call, const std::string &errmsg)
+                  {
+                      // 客户端只需要知道消息是否发送成功
+                      NewMessageResp resp;
+                      resp.set_requestid(call.req.requestid());
+                      resp.set_success(errmsg.empty());
+                      resp.set_errmsg(errmsg);
+                      return resp.SerializeAsString();
+                  })
+                ->key = chatSessionKey<NewMessageReq>;
+
+            // 消息管理(按聊天会话做一致性哈希)
+            route("/service/message/getHistoryMessage", _messageServiceName, &MessageService_Stub::GetHistoryMsg, sessionAuth(&GetHistoryMsgReq::loginsessionid))->key = chatSessionKey<GetHistoryMsgReq>;
+            route("/service/message/getRecentMsg", _messageServiceName, &MessageService_Stub::GetRecentMsg, sessionAuth(&GetRecentMsgReq::loginsessionid))->key = chatSessionKey<GetRecentMsgReq>;
+            route("/service/message/messageSearch", _messageServiceName, &MessageService_Stub::MsgSearch, sessionAuth(&MsgSearchReq::loginsessionid))->key = chatSessionKey<MsgSearchReq>;
+
+            // 文件管理
+            route("/service/file/getSingleFile", _fileServiceName, &FileService_Stub::GetSingleFile, sessionAuth(&GetSingleFileReq::sessionid));
+            route("/service/file/getMultiFile", _fileServiceName, &FileService_Stub::GetMultiFile, sessionAuth(&GetMultiFileReq::sessionid));
+            route("/service/file/putSingleFile", _fileServiceName, &FileService_Stub::PutSingleFile, sessionAuth(&PutSingleFileReq::sessionid))->retry = false;
+            route("/service/file/putMultiFile", _fileServiceName, &FileService_Stub::PutMultiFile, sessionAuth(&PutMultiFileReq::sessionid))->retry = false;
+            // 按摘要秒传：客户端上传前先提交文件摘要，exists为true时不需要再传输文件数据
+            route("/service/file/putFileByHash", _fileServiceName, &FileService_Stub::PutFileByHash, sessionAuth(&PutFileByHashReq::sessionid))->retry = false;
+
+            // 分块上传(进度与文件一样保存在共享存储上，任一节点都可以继续上传；按用户做一致性哈希使同一次上传的请求尽量落到同一个节点)
+            route("/service/file/initUpload", _fileServiceName, &FileService_Stub::InitUpload, sessionAuth(&InitUploadReq::sessionid))->key = userKey<InitUploadReq>;
+            route("/service/file/putChunk", _fileServiceName, &FileService_Stub::PutChunk, sessionAuth(&PutChunkReq::sessionid))->key = userKey<PutChunkReq>;
+            route("/service/file/queryUpload", _fileServiceName, &FileService_Stub::QueryUpload, sessionAuth(&QueryUploadReq::sessionid))->key = userKey<QueryUploadReq>;
+            route("/service/file/commitUpload", _fileServiceName, &FileService_Stub::CommitUpload, sessionAuth(&CommitUploadReq::sessionid))->key = userKey<CommitUploadReq>;
+
+            // 语音识别
+            route("/service/speech/recognition", _speechServiceName, &SpeechService_Stub::SpeechRecognition, sessionAuth(&SpeechReq::sessionid));
+
+            // 各接口的运行统计
+            _httpServer.Get("/service/stats", [this](const httplib::Request &request, httplib::Response &response)
+                            {
+                std::stringstream ss;
+                for (auto &stats : _routeStats)
+                    ss << stats->describe() << "\n";
+                response.set_content(ss.str(), "text/plain"); });
+
+            // 头像获取：GET /service/user/avatar?fileId=xxx&sessionId=xxx
+            // 与文件下载相同，需要登录会话，按分段流式返回；头像更换后文件id随之改变，客户端可以按文件id长期缓存
+            _httpServer.Get("/service/user/avatar", [this](const httplib::Request &request, httplib::Response &response)
+                            { downloadFile(request, response); });
+
+            // 文件下载(支持分段请求与条件请求)
+            _httpServer.Get("/service/file/download", [this](const httplib::Request &request, httplib::Response &response)
+                            { downloadFile(request, response); });
+        }
 
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到用户管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到用户管理子服务节点");
-            }
+        // 根据文件头部的特征字节判断图片与音视频类型
+        static std::string contentType(const std::string &data)
+        {
+            if (data.compare(0, 8, "\x89PNG\r\n\x1a\n") == 0)
+                return "image/png";
+            if (data.compare(0, 3, "\xff\xd8\xff") == 0)
+                return "image/jpeg";
+            if (data.compare(0, 4, "GIF8") == 0)
+                return "image/gif";
+            if (data.size() >= 12 && data.compare(0, 4, "RIFF") == 0 && data.compare(8, 4, "WEBP") == 0)
+                return "image/webp";
+            if (data.size() >= 12 && data.compare(0, 4, "RIFF") == 0 && data.compare(8, 4, "WAVE") == 0)
+                return "audio/wav";
+            if (data.size() >= 8 && data.compare(4, 4, "ftyp") == 0)
+                return "video/mp4";
+            if (data.compare(0, 4, "\x1a\x45\xdf\xa3") == 0)
+                return "video/webm";
+            if (data.compare(0, 4, "OggS") == 0)
+                return "audio/ogg";
+            if (data.compare(0, 3, "ID3") == 0 || data.compare(0, 2, "\xff\xfb") == 0)
+                return "audio/mpeg";
+            return "application/octet-stream";
+        }
 
-            UserService_Stub stub(channel.get());
+        // 调用文件子服务读取文件的一段数据
+        // 返回http状态码：200-成功  404-文件不存在  502-文件子服务调用失败
+        static int readFileRange(const ServiceChannel::ChannelPtr &channel,
+                                 const std::string &fileId, uint64_t offset, uint64_t length,
+                                 GetFileRangeResp &resp, butil::IOBuf &data)
+        {
+            GetFileRangeReq req;
+            req.set_requestid(fileId);
+            req.set_fileid(fileId);
+            req.set_offset(offset);
+            req.set_length(length);
             brpc::Controller cntl;
-            stub.SetUserPhoto(&cntl, &req, &resp, nullptr);
+            FileService_Stub stub(channel.get());
+            stub.GetFileRange(&cntl, &req, &resp, nullptr);
             if (cntl.Failed() || !resp.success())
             {
-                ERROR("{} - 用户子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("用户子服务调用失败：");
+                ERROR("读取文件 {} 的数据失败：{}", fileId, cntl.Failed() ? cntl.ErrorText() : resp.errmsg());
+                return !cntl.Failed() && resp.notfound() ? 404 : 502;
             }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
+            data.swap(cntl.response_attachment());
+            return 200;
         }
 
-        void setNickname(const httplib::Request &request, httplib::Response &response)
+        // 将IOBuf中最多n字节按数据块依次写给客户端，不拷贝到连续内存
+        static bool writeSink(httplib::DataSink &sink, const butil::IOBuf &buf, size_t n)
         {
-            // 取出http请求正文，将正文进行反序列化
-            SetNicknameReq req;
-            SetNicknameResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
+            for (size_t i = 0; i < buf.backing_block_num() && n > 0; ++i)
             {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
+                butil::StringPiece block = buf.backing_block(i);
+                size_t len = block.size() < n ? block.size() : n;
+                if (!sink.write(block.data(), len))
+                    return false;
+                n -= len;
+            }
+            return true;
+        }
 
-            if (!req.ParseFromString(request.body))
+        // 文件下载：GET /service/file/download?fileId=xxx&sessionId=xxx
+        // 同一文件id对应的内容不会变化，以文件id作为ETag；Range请求由httplib按文件大小计算并只读取需要的分段
+        // 文件数据按分段从文件子服务读取后直接写给客户端，网关内存中只保留当前分段
+        void downloadFile(const httplib::Request &request, httplib::Response &response)
+        {
+            std::string fileId = request.get_param_value("fileId");
+            if (fileId.empty())
             {
-                ERROR("设置用户昵称请求正文反序列化失败");
-                return err("设置用户昵称请求正文反序列化失败");
+                response.status = 400;
+                return;
             }
 
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
+            // 浏览器的媒体元素无法携带自定义请求头，登录会话id通过查询参数传递
+            if (!_loginSessionRedis->uid(request.get_param_value("sessionId")))
             {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
+                response.status = 401;
+                return;
             }
-            req.set_userid(*uid);
 
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
+            // 客户端持有的版本与请求的一致，无需重新传输
+            std::string etag = "\"" + fileId + "\"";
+            std::string match = request.get_header_value("If-None-Match");
+            if (match == "*" || match.find(etag) != std::string::npos)
             {
-                ERROR("{} - 未找到用户管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到用户管理子服务节点");
+                response.status = 304;
+                response.set_header("ETag", etag);
+                return;
             }
 
-            UserService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.SetUserNickname(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
+            auto channel = _channels->choose(_fileServiceName);
+            if (!channel)
             {
-                ERROR("{} - 用户子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("用户子服务调用失败：");
+                ERROR("未找到文件管理子服务节点 - {}", _fileServiceName);
+                response.status = 503;
+                return;
             }
 
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void setDesc(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            SetUserDescReq req;
-            SetUserDescResp resp;
+            // 第一个分段从文件头部开始时，读取该分段即可得到文件大小与媒体类型
+            // 否则先读取文件头部的几个字节得到文件大小与媒体类型，再按文件大小确定第一个分段的实际起点(包括按文件末尾计算的分段)
+            bool fromHead = request.ranges.empty() || request.ranges[0].first == 0;
+            uint64_t headLength = 16;
+            if (fromHead)
+                headLength = DOWNLOAD_CHUNK;
 
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
+            GetFileRangeResp head;
+            butil::IOBuf headData;
+            int status = readFileRange(channel, fileId, 0, headLength, head, headData);
+            if (status != 200)
             {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
+                response.status = status;
                 return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("设置用户签名请求正文反序列化失败");
-                return err("设置用户签名请求正文反序列化失败");
             }
 
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-            req.set_userid(*uid);
+            std::string magic;
+            headData.copy_to(&magic, 16);
+            std::string type = contentType(magic);
+            uint64_t fileSize = head.filesize();
 
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
+            auto prefetch = std::make_shared<butil::IOBuf>();
+            uint64_t prefetchOffset = 0;
+            if (fromHead)
             {
-                ERROR("{} - 未找到用户管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到用户管理子服务节点");
+                prefetch->swap(headData);
             }
-
-            UserService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.SetUserDescription(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
+            else
             {
-                ERROR("{} - 用户子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("用户子服务调用失败：");
-            }
+                const auto &range = request.ranges[0];
+                uint64_t start = range.first;
+                if (range.first < 0)
+                    start = (uint64_t)range.second < fileSize ? fileSize - range.second : 0;
 
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
+                // 起点超出文件末尾时不预读，由httplib按文件大小返回416
+                if (start < fileSize)
+                {
+                    GetFileRangeResp resp;
+                    status = readFileRange(channel, fileId, start, DOWNLOAD_CHUNK, resp, *prefetch);
+                    if (status != 200)
+                    {
+                        response.status = status;
+                        return;
+                    }
+                    prefetchOffset = resp.offset();
+                }
+            }
 
-        void setPhone(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            SetPhoneReq req;
-            SetPhoneResp resp;
+            response.set_header("ETag", etag);
+            response.set_header("Cache-Control", "private, max-age=31536000, immutable");
+            response.set_header("Accept-Ranges", "bytes");
 
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
+            if (fileSize == 0)
             {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
+                response.set_content("", type);
                 return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("设置用户电话号码请求正文反序列化失败");
-                return err("设置用户电话号码请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
             }
-            req.set_userid(*uid);
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到用户管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到用户管理子服务节点");
-            }
-
-            UserService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.SetUserPhoneNumber(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 用户子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("用户子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void getFriends(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            GetFriendListReq req;
-            GetFriendListResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("获取好友列表请求正文反序列化失败");
-                return err("获取好友列表请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-            req.set_userid(*uid);
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_friendServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到好友管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到好友管理子服务节点");
-            }
-
-            FriendService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetFriendList(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 好友管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("好友管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void addFriend(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            FriendAddReq req;
-            FriendAddResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("好友添加请求正文反序列化失败");
-                return err("好友添加请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-            req.set_userid(*uid);
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_friendServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到好友管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到好友管理子服务节点");
-            }
-
-            FriendService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.FriendAdd(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 好友管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("好友管理子服务调用失败：");
-            }
-
-            // 若业务处理完成后，则判断对方是否在线如若在线则实时发送申请消息
-            auto conn = _connection->connection(req.friendid());
-            if (resp.success() && conn)
-            {
-                auto user = _GetUserInfo(req.requestid(), *uid);
-                if (!user)
-                {
-                    ERROR("{} 获取当前客户端用户信息失败！", req.requestid());
-                    return err("获取当前客户端用户信息失败");
-                }
-                WebsocketMessage web;
-                web.set_type(WebsocketType::FRIEND_ADD_APPLY);
-                web.mutable_friendaddapply()->mutable_userinfo()->CopyFrom(user->user());
-                conn->send(web.SerializeAsString(), websocketpp::frame::opcode::value::binary);
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void friendAddProcess(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            FriendAddProcessReq req;
-            FriendAddProcessResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("处理好友添加请求正文反序列化失败");
-                return err("处理好友添加请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-            req.set_userid(*uid);
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_friendServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到好友管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到好友管理子服务节点");
-            }
-
-            FriendService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.FriendAddProcess(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 好友管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("好友管理子服务调用失败：");
-            }
-
-            // 如果处理完成，则判断对方是否在线
-            // 如若在线则发送处理通知
-            // 若是处理为同意则为在线的用户创建聊天会话
-            if (resp.success())
-            {
-                // 获取双方的用户信息
-                auto user = _GetUserInfo(req.requestid(), *uid);
-                if (!user)
-                {
-                    ERROR("{} 获取当前客户端用户信息失败！", req.requestid());
-                    return err("获取当前客户端用户信息失败");
-                }
-                auto friendInfo = _GetUserInfo(req.requestid(), req.applyuserid());
-                if (!friendInfo)
-                {
-                    ERROR("{} 获取当前客户端用户信息失败！", req.requestid());
-                    return err("获取当前客户端用户信息失败");
-                }
-
-                // 获取双方的长连接
-                auto userConn = _connection->connection(*uid);
-                auto friendConn = _connection->connection(req.applyuserid());
-
-                // 通知对方
-                if (friendConn)
-                {
-                    WebsocketMessage web;
-                    web.set_type(WebsocketType::FRIEND_ADD_PROCESS);
-                    auto res = web.mutable_friendprocessresult();
-                    res->mutable_userinfo()->CopyFrom(friendInfo->user());
-                    res->set_agree(req.agree());
-                    friendConn->send(web.SerializeAsString(), websocketpp::frame::opcode::value::binary);
-                }
-                // 给对方创建聊天会话
-                if (req.agree() && friendConn)
-                {
-                    WebsocketMessage web;
-                    web.set_type(WebsocketType::CHAT_SESSION_CREATE);
-                    auto session = web.mutable_newchatsessioninfo();
-                    session->mutable_chatsessioninfo()->set_singlechatfriendid(*uid);
-                    session->mutable_chatsessioninfo()->set_chatsessionid(resp.newchatsessionid());
-                    session->mutable_chatsessioninfo()->set_chatsessionname(user->user().nickname());
-                    session->mutable_chatsessioninfo()->set_photo(user->user().photo());
-                    friendConn->send(web.SerializeAsString(), websocketpp::frame::opcode::value::binary);
-                }
-                // 给自己创建聊天会话
-                if (req.agree() && userConn)
-                {
-                    WebsocketMessage web;
-                    web.set_type(WebsocketType::CHAT_SESSION_CREATE);
-                    auto session = web.mutable_newchatsessioninfo();
-                    session->mutable_chatsessioninfo()->set_singlechatfriendid(req.applyuserid());
-                    session->mutable_chatsessioninfo()->set_chatsessionid(resp.newchatsessionid());
-                    session->mutable_chatsessioninfo()->set_chatsessionname(friendInfo->user().nickname());
-                    session->mutable_chatsessioninfo()->set_photo(friendInfo->user().photo());
-                    friendConn->send(web.SerializeAsString(), websocketpp::frame::opcode::value::binary);
-                }
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void friendRemove(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            FriendRemoveReq req;
-            FriendRemoveResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("好友删除请求正文反序列化失败");
-                return err("好友删除请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_friendServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到好友管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到好友管理子服务节点");
-            }
-
-            FriendService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.FriendRemove(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 好友管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("好友管理子服务调用失败：");
-            }
-
-            // 若业务处理完成后，则判断对方是否在线如若在线则实时发送申请消息
-            auto conn = _connection->connection(req.friendid());
-            if (resp.success() && conn)
-            {
-                WebsocketMessage web;
-                web.set_type(WebsocketType::FRIEND_REMOVE);
-                web.mutable_friendremove()->set_userid(*uid);
-                conn->send(web.SerializeAsString(), websocketpp::frame::opcode::value::binary);
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void getFriendApplys(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            GetPendingFriendEventListReq req;
-            GetPendingFriendEventListResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("获取好友添加请求列表请求正文反序列化失败");
-                return err("获取好友添加请求列表请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_friendServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到好友管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到好友管理子服务节点");
-            }
-
-            FriendService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetPendingFriendEventList(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 好友管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("好友管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void friendSearch(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            FriendSearchReq req;
-            FriendSearchResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("好友查询请求正文反序列化失败");
-                return err("好友查询请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_friendServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到好友管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到好友管理子服务节点");
-            }
-
-            FriendService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.FriendSearch(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 好友管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("好友管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void getChatSessions(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            GetChatSessionListReq req;
-            GetChatSessionListResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("获取聊天会话列表请求正文反序列化失败");
-                return err("获取聊天会话列表请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_chatSessionServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到聊天会话管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到聊天会话管理子服务节点");
-            }
-
-            ChatSessionService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetChatSessionList(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 聊天会话管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("聊天会话管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void getChatSessionUser(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            GetChatSessionMemberReq req;
-            GetChatSessionMemberResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("获取聊天会话成员请求正文反序列化失败");
-                return err("获取聊天会话成员请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_chatSessionServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到聊天会话管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到聊天会话管理子服务节点");
-            }
-
-            ChatSessionService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetChatSessionMember(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 聊天会话管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("聊天会话管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void createChatSession(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            ChatSessionCreateReq req;
-            ChatSessionCreateResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("获取聊天会话成员请求正文反序列化失败");
-                return err("获取聊天会话成员请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_chatSessionServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到聊天会话管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到聊天会话管理子服务节点");
-            }
-
-            ChatSessionService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.ChatSessionCreate(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 聊天会话管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("聊天会话管理子服务调用失败：");
-            }
-
-            // 业务处理完毕 判断会话成员是否在线 在线的则发送通知
-            if (resp.success())
-            {
-                for (int i = 0; i < req.userids_size(); ++i)
-                {
-                    auto conn = _connection->connection(req.userids(i));
-                    if (!conn)
-                        break;
-
-                    WebsocketMessage web;
-                    web.set_type(WebsocketType::CHAT_SESSION_CREATE);
-                    auto session = web.mutable_newchatsessioninfo();
-                    session->mutable_chatsessioninfo()->CopyFrom(resp.chatsessioninfo());
-                    conn->send(web.SerializeAsString(), websocketpp::frame::opcode::value::binary);
-                }
-            }
-
-            resp.clear_chatsessioninfo();
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void getHistoryMessage(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            GetHistoryMsgReq req;
-            GetHistoryMsgResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("获取聊天会话历史消息请求正文反序列化失败");
-                return err("获取聊天会话历史消息请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_messageServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到消息管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到消息管理子服务节点");
-            }
-
-            MessageService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetHistoryMsg(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 消息管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("消息管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void getRecentMsg(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            GetRecentMsgReq req;
-            GetRecentMsgResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("获取指定条数历史消息请求正文反序列化失败");
-                return err("获取指定条数历史消息请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_messageServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到消息管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到消息管理子服务节点");
-            }
-
-            MessageService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetRecentMsg(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 消息管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("消息管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void messageSearch(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            MsgSearchReq req;
-            MsgSearchResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("消息搜索请求正文反序列化失败");
-                return err("消息搜索请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_messageServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到消息管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到消息管理子服务节点");
-            }
-
-            MessageService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.MsgSearch(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 消息管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("消息管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void getSingleFile(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            GetSingleFileReq req;
-            GetSingleFileResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("单个文件下载请求正文反序列化失败");
-                return err("单个文件下载请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.sessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_fileServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到文件管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到文件管理子服务节点");
-            }
-
-            FileService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetSingleFile(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 文件管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("文件管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void getMultiFile(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            GetMultiFileReq req;
-            GetMultiFileResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("多个文件下载请求正文反序列化失败");
-                return err("多个文件下载请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.sessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_fileServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到文件管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到文件管理子服务节点");
-            }
-
-            FileService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetMultiFile(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 文件管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("文件管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void putSingleFile(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            PutSingleFileReq req;
-            PutSingleFileResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("单个文件上传请求正文反序列化失败");
-                return err("单个文件上传请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.sessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_fileServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到文件管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到文件管理子服务节点");
-            }
-
-            FileService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.PutSingleFile(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 文件管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("文件管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void putMultiFile(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            PutMultiFileReq req;
-            PutMultiFileResp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("多个文件上传请求正文反序列化失败");
-                return err("多个文件上传请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.sessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_fileServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到文件管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到文件管理子服务节点");
-            }
-
-            FileService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.PutMultiFile(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 文件管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("文件管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void recognition(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            SpeechReq req;
-            SpeechRsp resp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("语音转文字请求正文反序列化失败");
-                return err("语音转文字请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.sessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_speechServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到语音管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到语音管理子服务节点");
-            }
-
-            SpeechService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.SpeechRecognition(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 语音管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("语音管理子服务调用失败：");
-            }
-
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-
-        void newMessage(const httplib::Request &request, httplib::Response &response)
-        {
-            // 取出http请求正文，将正文进行反序列化
-            NewMessageReq req;
-            NewMessageResp resp;
-            GetTransmitTargetResp tranResp;
-
-            // 错误处理函数(出错时调用)
-            auto err = [this, &req, &resp, &response](const std::string &errmsg) -> void
-            {
-                response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-                resp.set_success(false);
-                resp.set_errmsg(errmsg);
-                return;
-            };
-
-            if (!req.ParseFromString(request.body))
-            {
-                ERROR("新消息请求正文反序列化失败");
-                return err("新消息请求正文反序列化失败");
-            }
-
-            // 客户端身份识别与鉴权
-            std::string sid = req.loginsessionid();
-            auto uid = _loginSessionRedis->uid(sid);
-            if (!uid)
-            {
-                ERROR("获取登录会话关联用户信息失败 {}", sid);
-                return err("获取登录会话关联用户信息失败");
-            }
-
-            // 将请求转发给用户子服务进行业务处理
-            auto channel = _channels->choose(_chatSessionServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到聊天会话管理子服务节点 - {}", req.requestid(), _userServiceName);
-                return err("未找到聊天会话管理子服务节点");
-            }
-
-            ChatSessionService_Stub stub(channel.get());
-            brpc::Controller cntl;
-            stub.GetTransmitTarget(&cntl, &req, &tranResp, nullptr);
-            if (cntl.Failed() || !tranResp.success())
-            {
-                ERROR("{} - 聊天会话管理子服务调用失败：{}", req.requestid(), cntl.ErrorText());
-                return err("聊天会话管理子服务调用失败：");
-            }
-
-            // 业务处理成功后，将消息转发给聊天会话中的所有成员，不需要转发给自己
-            if (tranResp.success())
-            {
-                for (int i = 0; i < tranResp.targetids_size(); ++i)
-                {
-                    std::string id = tranResp.targetids(i);
-                    if (id == *uid)
-                        continue;
-
-                    auto conn = _connection->connection(id);
-                    if (!conn)
-                        continue;
-                    WebsocketMessage web;
-                    web.set_type(WebsocketType::CHAT_MESSAGE);
-                    auto message = web.mutable_newmessageinfo();
-                    message->mutable_messageinfo()->CopyFrom(tranResp.message());
-                    conn->send(web.SerializeAsString(), websocketpp::frame::opcode::value::binary);
-                }
-            }
-
-            resp.set_requestid(req.requestid());
-            resp.set_success(tranResp.success());
-            resp.set_errmsg(tranResp.errmsg());
-            // 得到用户子服务的响应后将响应内容进行序列化作为http响应正文
-            response.set_content(resp.SerializeAsString(), "application/x-protbuf");
-        }
-    };
+            response.set_content_provider(
+                fileSize, type,
+                [channel, fileId, prefetch, prefetchOffset](size_t offset, size_t length, httplib::DataSink &sink) -> bool
+                {
+                    // 预读的分段覆盖当前偏移时直接使用，只使用一次
+                    if (!prefetch->empty() && offset >= prefetchOffset && offset < prefetchOffset + prefetch->size())
+                    {
+                        prefetch->pop_front(offset - prefetchOffset);
+                        bool ok = writeSink(sink, *prefetch, length);
+                        prefetch->clear();
+                        return ok;
+                    }
+
+                    uint64_t n = length;
+                    if (n > DOWNLOAD_CHUNK)
+                        n = DOWNLOAD_CHUNK;
+
+                    GetFileRangeResp resp;
+                    butil::IOBuf buf;
+                    if (readFileRange(channel, fileId, offset, n, resp, buf) != 200 || buf.empty())
+                        return false;
+
+                    return writeSink(sink, buf, length);
+                });
+        }
+    };
 
     class GatewayServerBuilder
     {
@@ -1797,6 +928,15 @@ namespace hjb
         std::string _chatSessionServiceName; // 聊天会话服务的名称
         int _websocketPort;
         int _httpPort;
+        int _asyncHttpPort;
+        int _keepAliveInterval;
+        int _keepAliveTimeout;
+        int _ioThreads;
+        int _sessionCacheSize = 0;
+        int _sessionCacheTtl = 0;
+        int _sessionTtl = 600;
+        int _rpcTimeout = 3000;       // 子服务调用的时间预算(毫秒)
+        int _mediaRpcTimeout = 10000; // 文件与语音服务调用的时间预算(毫秒)
         std::shared_ptr<sw::redis::Redis> _redis;
         EtcdDisClient::ptr _disClient;
 
@@ -1805,9 +945,32 @@ namespace hjb
         void makeRedis(const std::string &host,
                        int port,
                        int db,
-                       bool keepAlive)
+                       bool keepAlive,
+                       int poolSize)
+        {
+            _redis = RedisClientFactory::create(host, port, db, keepAlive, poolSize);
+        }
+
+        // 登录会话的过期时长(秒)，需要大于长连接保活间隔
+        void makeSessionTtl(int ttl)
+        {
+            _sessionTtl = ttl;
+        }
+
+        // 开启登录会话的本地缓存
+        // capacity: 缓存的会话数量上限(不大于0表示不开启)  ttl: 缓存条目的存活时长(秒)
+        void makeSessionCache(int capacity, int ttl)
+        {
+            _sessionCacheSize = capacity;
+            _sessionCacheTtl = ttl;
+        }
+
+        // 子服务调用的时间预算(毫秒)，需要在 makeEtcdDis 之前设置
+        // rpcTimeout: 普通子服务  mediaRpcTimeout: 传输文件、识别语音等耗时较长的子服务
+        void makeRpcBudget(int rpcTimeout, int mediaRpcTimeout)
         {
-            _redis = RedisClientFactory::create(host, port, db, keepAlive);
+            _rpcTimeout = rpcTimeout;
+            _mediaRpcTimeout = mediaRpcTimeout;
         }
 
         // 构造服务发现客户端和信道管理对象
@@ -1827,22 +990,38 @@ namespace hjb
             _speechServiceName = speechServiceName;
             _chatSessionServiceName = chatSessionServiceName;
             _channels = std::make_shared<hjb::AllServiceChannel>();
-            _channels->declared(_fileServiceName);
-            _channels->declared(_friendServiceName);
-            _channels->declared(_messageServiceName);
-            _channels->declared(_userServiceName);
-            _channels->declared(_speechServiceName);
-            _channels->declared(_chatSessionServiceName);
+            ServiceOptions options;
+            options.timeoutMs = _rpcTimeout;
+            ServiceOptions mediaOptions;
+            mediaOptions.timeoutMs = _mediaRpcTimeout;
+            // 好友列表与最近消息是幂等的读接口，开启请求对冲以削减尾延迟
+            ServiceOptions friendOptions = options;
+            friendOptions.hedgedMethods = {"GetFriendList"};
+            ServiceOptions messageOptions = options;
+            messageOptions.hedgedMethods = {"GetRecentMsg"};
+            _channels->declared(_fileServiceName, mediaOptions);
+            _channels->declared(_friendServiceName, friendOptions);
+            _channels->declared(_messageServiceName, messageOptions);
+            _channels->declared(_userServiceName, options);
+            _channels->declared(_speechServiceName, mediaOptions);
+            _channels->declared(_chatSessionServiceName, options);
 
             auto putCb = std::bind(&hjb::AllServiceChannel::onServiceOnline, _channels.get(), std::placeholders::_1, std::placeholders::_2);
             auto delCb = std::bind(&hjb::AllServiceChannel::onServiceOffline, _channels.get(), std::placeholders::_1, std::placeholders::_2);
             _disClient = std::make_shared<hjb::EtcdDisClient>(regHost, baseServiceName, putCb, delCb);
         }
 
-        void makeServerObject(int websocketPort, int httpPort)
+        // keepAliveInterval: 长连接ping间隔(秒)  keepAliveTimeout: 长连接无响应判定失活的时长(秒)
+        // ioThreads: websocket服务器的io线程数量
+        // asyncHttpPort: 非阻塞http服务器的监听端口，不大于0表示不开启
+        void makeServerObject(int websocketPort, int httpPort, int asyncHttpPort, int keepAliveInterval, int keepAliveTimeout, int ioThreads)
         {
+            _ioThreads = ioThreads;
             _websocketPort = websocketPort;
             _httpPort = httpPort;
+            _asyncHttpPort = asyncHttpPort;
+            _keepAliveInterval = keepAliveInterval;
+            _keepAliveTimeout = keepAliveTimeout;
         }
 
         // 构造RPC服务器对象
@@ -1865,6 +1044,9 @@ namespace hjb
             }
 
             GatewayServer::ptr server = std::make_shared<GatewayServer>(_redis,
+                                                                        _sessionCacheSize,
+                                                                        _sessionCacheTtl,
+                                                                        _sessionTtl,
                                                                         _channels,
                                                                         _fileServiceName,
                                                                         _messageServiceName,
@@ -1874,6 +1056,10 @@ namespace hjb
                                                                         _chatSessionServiceName,
                                                                         _websocketPort,
                                                                         _httpPort,
+                                                                        _asyncHttpPort,
+                                                                        _keepAliveInterval,
+                                                                        _keepAliveTimeout,
+                                                                        _ioThreads,
                                                                         _disClient);
             return server;
         }
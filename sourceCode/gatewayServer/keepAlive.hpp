@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <functional>
+#include <ctime>
+
+#include "connection.hpp"
+
+namespace hjb
+{
+    // 基于时间轮的长连接保活管理
+    // 整个网关只使用一个每秒触发一次的定时器，时间轮每个槽位对应一秒
+    // 每个刻度只处理落在当前槽位上的连接：存活的批量发送ping并放回槽位等待下一轮，失活的直接关闭
+    // 所有连接的保活间隔相同，轮子一圈正好是一个保活间隔，因此单层时间轮就足够了
+    class KeepAliveWheel
+    {
+    public:
+        using ptr = std::shared_ptr<KeepAliveWheel>;
+        using TickCallback = std::function<void(const std::vector<wserver::connection_ptr> &)>; // 每个刻度上存活连接的回调
+
+    private:
+        // 时间轮上的一个连接节点
+        struct Node
+        {
+            websocketpp::connection_hdl hdl; // 连接句柄(弱引用，不延长连接生命周期)
+            time_t active;                   // 最近一次收到客户端数据的时间
+            size_t slot;                     // 节点当前所在的槽位
+        };
+
+        wserver &_server;
+        int _timeout;                                   // 超过该时长(秒)未收到任何响应视为失活连接
+        std::vector<std::vector<const void *>> _slots; // 时间轮槽位，存放连接对象地址
+        std::unordered_map<const void *, Node> _nodes; // 连接对象地址与节点的映射
+        size_t _cursor;                                 // 当前刻度指向的槽位
+        TickCallback _onTick;                           // 存活连接回调(每条连接每个保活间隔触发一次)
+        std::mutex _mutex;
+
+    public:
+        // interval: 发送ping的间隔(秒)  timeout: 判定连接失活的时长(秒)
+        KeepAliveWheel(wserver &server, int interval, int timeout)
+            : _server(server),
+              _timeout(timeout),
+              _slots(interval > 0 ? interval : 1),
+              _cursor(0)
+        {
+        }
+
+        // 设置存活连接回调，需要在start之前调用
+        void setTickCallback(const TickCallback &cb)
+        {
+            _onTick = cb;
+        }
+
+        // 启动时间轮，需要在websocket服务器初始化io之后调用
+        void start()
+        {
+            _server.set_timer(1000, std::bind(&KeepAliveWheel::tick, this, std::placeholders::_1));
+        }
+
+        // 新连接加入保活管理，一个保活间隔后开始第一次ping
+        void insert(const wserver::connection_ptr &conn)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            const void *key = conn.get();
+            if (_nodes.find(key) != _nodes.end())
+                return;
+
+            _nodes[key] = Node{conn, time(nullptr), _cursor};
+            _slots[_cursor].push_back(key);
+        }
+
+        // 收到客户端的数据(pong或普通消息)，刷新连接活跃时间
+        void touch(const wserver::connection_ptr &conn)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            auto it = _nodes.find(conn.get());
+            if (it != _nodes.end())
+                it->second.active = time(nullptr);
+        }
+
+        // 连接断开时移出保活管理，同时从槽位中删除其地址
+        // 新连接可能复用同一地址，残留的地址会使该地址在槽位中重复，连接每轮被处理多次
+        void remove(const wserver::connection_ptr &conn)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            auto it = _nodes.find(conn.get());
+            if (it == _nodes.end())
+                return;
+
+            auto &slot = _slots[it->second.slot];
+            auto pos = std::find(slot.begin(), slot.end(), it->first);
+            if (pos != slot.end())
+            {
+                *pos = slot.back();
+                slot.pop_back();
+            }
+            _nodes.erase(it);
+        }
+
+    private:
+        void tick(const websocketpp::lib::error_code &ec)
+        {
+            if (ec)
+            {
+                WARN("保活时间轮定时器异常：{}", ec.message());
+                return;
+            }
+
+            time_t now = time(nullptr);
+            std::vector<wserver::connection_ptr> alive;   // 本刻度需要ping的连接
+            std::vector<wserver::connection_ptr> expired; // 本刻度判定失活的连接
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+
+                _cursor = (_cursor + 1) % _slots.size();
+                std::vector<const void *> keys;
+                keys.swap(_slots[_cursor]);
+
+                for (const void *key : keys)
+                {
+                    auto it = _nodes.find(key);
+                    if (it == _nodes.end() || it->second.slot != _cursor)
+                        continue;
+
+                    websocketpp::lib::error_code cec;
+                    wserver::connection_ptr conn = _server.get_con_from_hdl(it->second.hdl, cec);
+                    if (cec || !conn || conn->get_state() != websocketpp::session::state::value::open)
+                    {
+                        _nodes.erase(it);
+                        continue;
+                    }
+
+                    if (now - it->second.active > _timeout)
+                    {
+                        expired.push_back(conn);
+                        _nodes.erase(it);
+                        continue;
+                    }
+
+                    alive.push_back(conn);
+                    _slots[_cursor].push_back(key);
+                }
+            }
+
+            for (auto &conn : alive)
+            {
+                websocketpp::lib::error_code pec;
+                conn->ping("", pec);
+            }
+
+            if (_onTick && !alive.empty())
+                _onTick(alive);
+
+            for (auto &conn : expired)
+            {
+                DEBUG("长连接 {} 保活超时，关闭连接", (size_t)conn.get());
+                websocketpp::lib::error_code cec;
+                conn->close(websocketpp::close::status::going_away, "保活超时", cec);
+            }
+
+            _server.set_timer(1000, std::bind(&KeepAliveWheel::tick, this, std::placeholders::_1));
+        }
+    };
+}
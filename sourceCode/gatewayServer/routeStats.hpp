@@ -0,0 +1,78 @@
+#pragma once
+
+#include <bvar/bvar.h>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <memory>
+
+namespace hjb
+{
+    // 单个http接口的运行统计：QPS、延迟分位值与失败率
+    // 失败分为子服务失败与客户端错误(请求正文无效、鉴权失败、已超过截止时间)，分别计数
+    // 统计值基于bvar，命名为 gateway_<接口路径>；网关开启监控端口时可以通过brpc的内置监控页面查看
+    class RouteStats
+    {
+    public:
+        using ptr = std::shared_ptr<RouteStats>;
+
+    private:
+        static const time_t WINDOW = 10; // QPS与失败率的统计窗口(秒)
+
+        std::string _path;
+        bvar::LatencyRecorder _latency;                   // 请求耗时(微秒)，同时提供QPS与分位值
+        bvar::Adder<int64_t> _errors;                     // 子服务失败的累计数量
+        bvar::Window<bvar::Adder<int64_t>> _recentErrors; // 统计窗口内子服务失败的数量
+        bvar::Adder<int64_t> _clientErrors;               // 客户端错误的累计数量
+        bvar::Window<bvar::Adder<int64_t>> _recentClientErrors; // 统计窗口内客户端错误的数量
+
+        static std::string exposeName(const std::string &path)
+        {
+            std::string name = "gateway" + path;
+            std::replace(name.begin(), name.end(), '/', '_');
+            return name;
+        }
+
+    public:
+        RouteStats(const std::string &path)
+            : _path(path),
+              _latency(exposeName(path)),
+              _recentErrors(exposeName(path) + "_error", &_errors, WINDOW),
+              _recentClientErrors(exposeName(path) + "_client_error", &_clientErrors, WINDOW)
+        {
+        }
+
+        // 记录一次请求，start为开始处理请求的时间
+        // success为false时，clientError区分客户端错误与子服务失败
+        void record(std::chrono::steady_clock::time_point start, bool success, bool clientError = false)
+        {
+            auto cost = std::chrono::steady_clock::now() - start;
+            _latency << std::chrono::duration_cast<std::chrono::microseconds>(cost).count();
+            if (success)
+                return;
+            if (clientError)
+                _clientErrors << 1;
+            else
+                _errors << 1;
+        }
+
+        // 以文本形式输出当前统计值
+        std::string describe()
+        {
+            int64_t total = _latency.qps(WINDOW) * WINDOW;
+            double errorRate = total > 0 ? 100.0 * _recentErrors.get_value() / total : 0;
+            double clientErrorRate = total > 0 ? 100.0 * _recentClientErrors.get_value() / total : 0;
+
+            std::stringstream ss;
+            ss << _path
+               << " qps=" << _latency.qps(WINDOW)
+               << " p50=" << _latency.latency_percentile(0.5) << "us"
+               << " p99=" << _latency.latency_percentile(0.99) << "us"
+               << " error=" << std::fixed << std::setprecision(2) << errorRate << "%"
+               << " client_error=" << clientErrorRate << "%"
+               << " total=" << _latency.count();
+            return ss.str();
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include <gflags/gflags.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "../httplib.h"
+#include "log.hpp"
+#include "user.pb.h"
+
+DEFINE_bool(runMode, false, "程序的运行模式，false-调试； true-发布；");
+DEFINE_string(logFile, "", "发布模式下指定日志的输出文件");
+DEFINE_int32(logLevel, 0, "发布模式下指定日志输出等级");
+
+DEFINE_string(host, "127.0.0.1", "网关地址");
+DEFINE_int32(port, 8400, "网关http端口(阻塞式或非阻塞式)");
+DEFINE_string(path, "/service/user/getUserInfo", "压测的接口路径");
+DEFINE_string(sessionId, "", "压测使用的登录会话id");
+DEFINE_int32(threads, 64, "并发的客户端数量");
+DEFINE_int32(requests, 1000, "每个客户端发送的请求数量");
+
+// 网关压测工具
+// 每个线程持有一个长连接客户端，串行发送请求并记录每个请求的耗时
+// 分别指定阻塞式和非阻塞式http端口运行，对比两种模式下的QPS和尾延迟
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    hjb::initLogger(FLAGS_runMode, FLAGS_logFile, FLAGS_logLevel);
+
+    hjb::GetUserInfoReq req;
+    req.set_requestid("bench");
+    req.set_loginsessionid(FLAGS_sessionId);
+    std::string body = req.SerializeAsString();
+
+    std::vector<std::vector<int64_t>> latency(FLAGS_threads); // 每个线程记录的请求耗时(微秒)
+    std::atomic<int64_t> failed(0);
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < FLAGS_threads; ++i)
+    {
+        threads.emplace_back([i, &body, &latency, &failed]()
+                             {
+            httplib::Client client(FLAGS_host, FLAGS_port);
+            client.set_keep_alive(true);
+            latency[i].reserve(FLAGS_requests);
+
+            for (int n = 0; n < FLAGS_requests; ++n)
+            {
+                auto start = std::chrono::steady_clock::now();
+                auto res = client.Post(FLAGS_path, body, "application/x-protbuf");
+                auto cost = std::chrono::steady_clock::now() - start;
+
+                if (!res || res->status != 200)
+                {
+                    ++failed;
+                    continue;
+                }
+                latency[i].push_back(std::chrono::duration_cast<std::chrono::microseconds>(cost).count());
+            } });
+    }
+    for (auto &t : threads)
+        t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::vector<int64_t> all;
+    for (auto &v : latency)
+        all.insert(all.end(), v.begin(), v.end());
+    if (all.empty())
+    {
+        ERROR("所有请求均失败，失败数量：{}", failed.load());
+        return -1;
+    }
+    std::sort(all.begin(), all.end());
+
+    auto percentile = [&all](double p) -> int64_t
+    {
+        return all[std::min(all.size() - 1, (size_t)(all.size() * p))];
+    };
+
+    INFO("接口：{}:{}{} 并发：{} 成功：{} 失败：{}", FLAGS_host, FLAGS_port, FLAGS_path, FLAGS_threads, all.size(), failed.load());
+    INFO("QPS：{:.0f} p50：{}us p99：{}us max：{}us", all.size() / seconds, percentile(0.5), percentile(0.99), all.back());
+    return 0;
+}
\ No newline at end of file
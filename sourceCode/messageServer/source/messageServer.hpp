@@ -8,6 +8,9 @@
 #include "esData.hpp"
 #include "util.hpp"
 #include "channel.hpp"
+#include "redis.hpp"
+#include "userProfileCache.hpp"
+#include "fileUpload.hpp"
 #include "rabbitMQ.hpp"
 
 #include "user.pb.h"
@@ -26,18 +29,21 @@ namespace hjb
         std::string _fileServiceName;     // 文件服务的名称
         std::string _userServiceName;     // 用户服务的名称
         AllServiceChannel::ptr _channels; // 服务信道操作对象
+        UserProfileCache::ptr _userCache; // 用户信息获取对象(未开启缓存时直接调用用户子服务)
 
     public:
         MessageServiceImpl(const std::shared_ptr<elasticlient::Client> &es,
                            const std::shared_ptr<odb::core::database> &mysql,
                            const AllServiceChannel::ptr &channels,
                            const std::string &fileServiceName,
-                           const std::string &userServiceName)
+                           const std::string &userServiceName,
+                           const UserProfileCache::ptr &userCache)
             : _es(std::make_shared<ESMessage>(es)),
               _mysql(std::make_shared<MessageTable>(mysql)),
               _userServiceName(userServiceName),
               _fileServiceName(fileServiceName),
-              _channels(channels)
+              _channels(channels),
+              _userCache(userCache)
         {
             // 创建es索引
             _es->createIndex();
@@ -356,11 +362,14 @@ namespace hjb
                 }
                 break;
 
-            // 其他消息则将数据存储到文件子服务，并获取文件id
+            // 其他消息的数据已由聊天会话子服务存入文件子服务，消息中只携带文件id
+            // 兼容仍携带数据的旧消息：将数据存储到文件子服务，并获取文件id
             case MessageType::IMAGE:
             {
                 const auto &msg = message.message().imagemessage();
-                if (!_putFiles("", msg.content(), msg.content().size(), fileId))
+                if (msg.has_fileid() && !msg.fileid().empty())
+                    fileId = msg.fileid();
+                else if (!_putFiles(message.sender().userid(), "", message.mutable_message()->mutable_imagemessage()->mutable_content(), fileId))
                 {
                     ERROR("上传图片到文件子服务失败");
                     return;
@@ -372,7 +381,9 @@ namespace hjb
                 const auto &msg = message.message().filemessage();
                 fileName = msg.filename();
                 fileSize = msg.filesize();
-                if (!_putFiles(fileName, msg.filecontent(), fileSize, fileId))
+                if (msg.has_fileid() && !msg.fileid().empty())
+                    fileId = msg.fileid();
+                else if (!_putFiles(message.sender().userid(), fileName, message.mutable_message()->mutable_filemessage()->mutable_filecontent(), fileId))
                 {
                     ERROR("上传文件到文件子服务失败");
                     return;
@@ -382,7 +393,9 @@ namespace hjb
             case MessageType::SPEECH:
             {
                 const auto &msg = message.message().speechmessage();
-                if (!_putFiles("", msg.content(), msg.content().size(), fileId))
+                if (msg.has_fileid() && !msg.fileid().empty())
+                    fileId = msg.fileid();
+                else if (!_putFiles(message.sender().userid(), "", message.mutable_message()->mutable_speechmessage()->mutable_content(), fileId))
                 {
                     ERROR("上传语音到文件子服务失败");
                     return;
@@ -412,35 +425,13 @@ namespace hjb
         }
 
     private:
+        // 批量获取用户信息，开启缓存时优先从本地缓存获取
         bool _getUsers(const std::string &requestId,
                        const std::unordered_set<std::string> &userIds,
                        std::unordered_map<std::string, UserProto> &users)
         {
-            auto channel = _channels->choose(_userServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到用户管理子服务节点 - {}", requestId, _userServiceName);
-                return false;
-            }
-            GetMultiUserInfoReq req;
-            GetMultiUserInfoResp resp;
-            brpc::Controller cntl;
-            UserService_Stub stub(channel.get());
-            req.set_requestid(requestId);
-            for (const auto &id : userIds)
-                req.add_userids(id);
-
-            stub.GetMultiUserInfo(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 用户子服务调用失败：{}", requestId, cntl.ErrorText());
-                return false;
-            }
-
-            for (auto it = resp.users().begin(); it != resp.users().end(); ++it)
-                users.insert(std::make_pair(it->first, it->second));
-
-            return true;
+            std::vector<std::string> ids(userIds.begin(), userIds.end());
+            return _userCache->get(requestId, ids, users);
         }
 
         bool _getFiles(const std::string &requestId,
@@ -453,30 +444,39 @@ namespace hjb
                 ERROR("{} - 未找到文件管理子服务节点 - {}", requestId, _fileServiceName);
                 return false;
             }
-            GetMultiFileReq req;
-            GetMultiFileResp resp;
-            brpc::Controller cntl;
             FileService_Stub stub(channel.get());
+            GetMultiFileReq req;
             req.set_requestid(requestId);
             for (const auto &id : files)
                 req.add_fileidlist(id);
 
-            stub.GetMultiFile(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
+            // 文件数据超出单次响应上限时按返回的剩余文件ID继续请求
+            while (req.fileidlist_size() > 0)
             {
-                ERROR("{} - 文件子服务调用失败：{}", requestId, cntl.ErrorText());
-                return false;
-            }
+                GetMultiFileResp resp;
+                brpc::Controller cntl;
+                stub.GetMultiFile(&cntl, &req, &resp, nullptr);
+                if (cntl.Failed() || !resp.success())
+                {
+                    ERROR("{} - 文件子服务调用失败：{}", requestId, cntl.ErrorText());
+                    return false;
+                }
 
-            for (auto it = resp.filedata().begin(); it != resp.filedata().end(); ++it)
-                fileDatas.insert(std::make_pair(it->first, it->second.filecontent()));
+                for (auto &file : *resp.mutable_filedata())
+                    fileDatas[file.first].swap(*file.second.mutable_filecontent());
+                for (auto it = resp.failedfiles().begin(); it != resp.failedfiles().end(); ++it)
+                    WARN("{} - 文件 {} 下载失败：{}", requestId, it->first, it->second);
+
+                req.mutable_fileidlist()->Swap(resp.mutable_pendingfileids());
+            }
 
             return true;
         }
 
-        bool _putFiles(const std::string &fileName,
-                       const std::string &body,
-                       const int64_t fileSize,
+        // 代发送者上传一份文件数据，数据交给上传请求后body被清空
+        bool _putFiles(const std::string &userId,
+                       const std::string &fileName,
+                       std::string *body,
                        std::string &fileId)
         {
             auto channel = _channels->choose(_fileServiceName);
@@ -485,24 +485,8 @@ namespace hjb
                 ERROR("未找到文件管理子服务节点 - {}", _fileServiceName);
                 return false;
             }
-            PutSingleFileReq req;
-            PutSingleFileResp resp;
-            brpc::Controller cntl;
-            FileService_Stub stub(channel.get());
-            req.mutable_filedata()->set_filename(fileName);
-            req.mutable_filedata()->set_filesize(fileSize);
-            req.mutable_filedata()->set_filecontent(body);
 
-            stub.PutSingleFile(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("文件子服务调用失败：{}", cntl.ErrorText());
-                return false;
-            }
-
-            fileId = resp.fileinfo().fileid();
-
-            return true;
+            return FileUploader::put(channel.get(), "", userId, fileName, body, fileId);
         }
     };
 
@@ -543,7 +527,7 @@ namespace hjb
         }
     };
 
-    class MessageServerBuilder
+    class MessageServerBuilder : public UserProfileCacheBuilder
     {
     private:
         hjb::EtcdDisClient::ptr _disClient;
@@ -601,8 +585,15 @@ namespace hjb
             _fileServiceName = fileServiceName;
             _userServiceName = userServiceName;
             _channels = std::make_shared<hjb::AllServiceChannel>();
-            _channels->declared(fileServiceName);
-            _channels->declared(userServiceName);
+            // 批量获取文件与用户信息是幂等的读接口，开启请求对冲以削减尾延迟
+            // 文件服务需要传输媒体数据，使用更长的时间预算
+            ServiceOptions fileOptions;
+            fileOptions.timeoutMs = 10000;
+            fileOptions.hedgedMethods = {"GetMultiFile"};
+            ServiceOptions userOptions;
+            userOptions.hedgedMethods = {"GetMultiUserInfo"};
+            _channels->declared(fileServiceName, fileOptions);
+            _channels->declared(userServiceName, userOptions);
 
             auto putCb = std::bind(&hjb::AllServiceChannel::onServiceOnline, _channels.get(), std::placeholders::_1, std::placeholders::_2);
             auto delCb = std::bind(&hjb::AllServiceChannel::onServiceOffline, _channels.get(), std::placeholders::_1, std::placeholders::_2);
@@ -644,7 +635,7 @@ namespace hjb
 
             _brpcServer = std::make_shared<brpc::Server>();
 
-            MessageServiceImpl *service = new MessageServiceImpl(_es, _mysql, _channels, _fileServiceName, _userServiceName);
+            MessageServiceImpl *service = new MessageServiceImpl(_es, _mysql, _channels, _fileServiceName, _userServiceName, buildUserCache(_channels, _userServiceName));
             if (_brpcServer->AddService(service, brpc::ServiceOwnership::SERVER_OWNS_SERVICE) == -1)
             {
                 ERROR("添加Rpc服务失败");
@@ -15,6 +15,7 @@ DEFINE_string(Rhost, "127.0.0.1", "服务器地址");
 DEFINE_int32(Rport, 6379, "服务器端口");
 DEFINE_int32(Rdb, 0, "库的编号");
 DEFINE_bool(RkeepAlive, true, "是否启动长连接保活");
+DEFINE_int32(sessionTtl, 600, "登录会话的过期时长(秒)，需与网关保持一致");
 
 DEFINE_string(Mhost, "127.0.0.1", "mysql服务器地址");
 DEFINE_int32(Mport, 3306, "mysql服务器端口");
@@ -46,7 +47,7 @@ int main(int argc, char *argv[])
     usb.makeMysql(FLAGS_Muser, FLAGS_Mpwd, FLAGS_Mhost,
                   FLAGS_Mdb, FLAGS_Mcharset, FLAGS_Mport, FLAGS_MmaxPool);
     
-    usb.makeRedis(FLAGS_Rhost, FLAGS_Rport, FLAGS_Rdb, FLAGS_RkeepAlive);
+    usb.makeRedis(FLAGS_Rhost, FLAGS_Rport, FLAGS_Rdb, FLAGS_RkeepAlive, FLAGS_sessionTtl);
     
     usb.makeEtcdDis(FLAGS_registryHost, FLAGS_baseService, FLAGS_file_service);
     
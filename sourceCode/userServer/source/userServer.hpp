@@ -10,6 +10,8 @@
 #include "util.hpp"
 #include "dms.hpp"
 #include "channel.hpp"
+#include "userProfileCache.hpp"
+#include "fileUpload.hpp"
 
 #include "user.pb.h"
 #include "base.pb.h"
@@ -24,8 +26,9 @@ namespace hjb
         ESUser::ptr _es;                  // 用户es操作类对象
         UserTable::ptr _mysql;            // 用户数据库操作对象
         LoginSession::ptr _session;       // 用户redis登录会话操作对象
-        LoginStatus::ptr _status;         // 用户redis登录状态操作对象
         VerifyCode::ptr _code;            // 用户redis验证码操作对象
+        std::shared_ptr<sw::redis::Redis> _redis; // redis客户端(用于创建批量操作对象)
+        std::chrono::seconds _sessionTtl;         // 登录会话的过期时长
         std::string _fileServiceName;     // 文件服务的名称
         AllServiceChannel::ptr _channels; // 用户服务信道操作对象
         DMSClient::ptr _dms;              // 短信验证码获取操作对象
@@ -35,13 +38,15 @@ namespace hjb
                         const std::shared_ptr<elasticlient::Client> &es,
                         const std::shared_ptr<odb::core::database> &mysql,
                         const std::shared_ptr<sw::redis::Redis> &redis,
+                        int sessionTtl,
                         const AllServiceChannel::ptr &channels,
                         const std::string &fileServiceName)
             : _es(std::make_shared<ESUser>(es)),
               _mysql(std::make_shared<UserTable>(mysql)),
               _session(std::make_shared<LoginSession>(redis)),
-              _status(std::make_shared<LoginStatus>(redis)),
               _code(std::make_shared<VerifyCode>(redis)),
+              _redis(redis),
+              _sessionTtl(sessionTtl),
               _fileServiceName(fileServiceName),
               _channels(channels),
               _dms(dms)
@@ -264,19 +269,10 @@ namespace hjb
                 return err(request->requestid(), "用户名或密码错误");
             }
 
-            // 判断该用户是否已经登录
-            if (_status->exists(userId))
-            {
-                ERROR("{} - 用户已在其他地方登录 - {}", request->requestid(), userId);
-                return err(request->requestid(), "用户已在其他地方登录");
-            }
-
-            // 构建登录会话id
+            // 构建登录会话id(支持多设备同时登录，每台设备拥有独立的登录会话)
             std::string sessionId = hjb::uuid();
             // 添加登录会话信息
-            _session->append(sessionId, userId);
-            // 添加用户登录状态
-            _status->append(userId);
+            _session->append(sessionId, userId, _sessionTtl);
 
             // 响应
             response->set_requestid(request->requestid());
@@ -330,22 +326,12 @@ namespace hjb
                 return err(request->requestid(), "验证码错误");
             }
 
-            // 移除刚验证的验证码
-            _code->remove(request->verifycodeid());
-
-            // 判断该用户是否已经登录
-            if (_status->exists(user->userId()))
-            {
-                ERROR("{} - 用户已在其他地方登录 - {}", request->requestid(), user->userId());
-                return err(request->requestid(), "用户已在其他地方登录");
-            }
-
-            // 构建登录会话id
-            std::string sessionId = hjb::uuid();
-            // 添加登录会话信息
-            _session->append(sessionId, user->userId());
-            // 添加用户登录状态
-            _status->append(user->userId());
+            // 移除刚验证的验证码，同时添加登录会话信息，合并为一次往返
+            std::string sessionId = hjb::uuid(); // 支持多设备同时登录，每台设备拥有独立的登录会话
+            auto pipe = _redis->pipeline(false);
+            _code->remove(pipe, request->verifycodeid());
+            _session->append(pipe, sessionId, user->userId(), _sessionTtl);
+            pipe.exec();
 
             // 响应
             response->set_requestid(request->requestid());
@@ -395,6 +381,8 @@ namespace hjb
             // 根据用户的文件id获取文件数据
             auto photoId = user->userPhotoId();
             if (photoId)
+                respUser->set_photoid(*photoId);
+            if (photoId && !request->photobyref())
             {
                 // 创建信道连接到文件服务
                 auto channel = _channels->choose(_fileServiceName);
@@ -458,32 +446,49 @@ namespace hjb
                 return err(request->requestid(), "从数据库查找的用户信息数量不一致");
             }
 
-            // 创建信道连接到文件服务
-            auto channel = _channels->choose(_fileServiceName);
-            if (!channel)
-            {
-                ERROR("{} - 未找到文件管理子服务节点 - {}", request->requestid(), _fileServiceName);
-                return err(request->requestid(), "未找到文件管理子服务节点");
-            }
-
-            // 进行rpc请求下载文件数据
-            hjb::FileService_Stub stub(channel.get());
-            hjb::GetMultiFileReq req;
+            // 引用模式下只返回头像文件id，不再下载头像数据
             hjb::GetMultiFileResp resp;
-            req.set_requestid(request->requestid());
-            brpc::Controller cntl;
-            for (auto &user : users)
+            if (!request->photobyref())
             {
-                if (user.userPhotoId()->empty())
-                    continue;
+                // 创建信道连接到文件服务
+                auto channel = _channels->choose(_fileServiceName);
+                if (!channel)
+                {
+                    ERROR("{} - 未找到文件管理子服务节点 - {}", request->requestid(), _fileServiceName);
+                    return err(request->requestid(), "未找到文件管理子服务节点");
+                }
 
-                req.add_fileidlist(*user.userPhotoId());
-            }
-            stub.GetMultiFile(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() || !resp.success())
-            {
-                ERROR("{} - 文件子服务调用失败：{}", request->requestid(), cntl.ErrorText());
-                return err(request->requestid(), "文件子服务调用失败");
+                // 进行rpc请求下载文件数据
+                hjb::FileService_Stub stub(channel.get());
+                hjb::GetMultiFileReq req;
+                req.set_requestid(request->requestid());
+                for (auto &user : users)
+                {
+                    if (!user.userPhotoId() || user.userPhotoId()->empty())
+                        continue;
+
+                    req.add_fileidlist(*user.userPhotoId());
+                }
+
+                // 文件数据超出单次响应上限时按返回的剩余文件ID继续请求，结果合并到resp中
+                while (req.fileidlist_size() > 0)
+                {
+                    hjb::GetMultiFileResp page;
+                    brpc::Controller cntl;
+                    stub.GetMultiFile(&cntl, &req, &page, nullptr);
+                    if (cntl.Failed() || !page.success())
+                    {
+                        ERROR("{} - 文件子服务调用失败：{}", request->requestid(), cntl.ErrorText());
+                        return err(request->requestid(), "文件子服务调用失败");
+                    }
+
+                    for (auto &file : *page.mutable_filedata())
+                        (*resp.mutable_filedata())[file.first].Swap(&file.second);
+                    for (auto it = page.failedfiles().begin(); it != page.failedfiles().end(); ++it)
+                        WARN("{} - 头像文件 {} 下载失败：{}", request->requestid(), it->first, it->second);
+
+                    req.mutable_fileidlist()->Swap(page.mutable_pendingfileids());
+                }
             }
 
             for (auto &user : users)
@@ -500,7 +505,12 @@ namespace hjb
                     userInfo.set_desc(*user.desc());
                 userInfo.set_phone(user.phone());
 
-                userInfo.set_photo((*fileMap)[*user.userPhotoId()].filecontent());
+                if (user.userPhotoId())
+                {
+                    userInfo.set_photoid(*user.userPhotoId());
+                    if (!request->photobyref())
+                        userInfo.set_photo((*fileMap)[*user.userPhotoId()].filecontent());
+                }
 
                 (*userMap)[userInfo.userid()] = userInfo;
             }
@@ -548,21 +558,11 @@ namespace hjb
                 return err(request->requestid(), "未找到文件管理子服务节点");
             }
 
-            hjb::FileService_Stub stub(channel.get());
-            hjb::PutSingleFileReq req;
-            hjb::PutSingleFileResp resp;
-            req.set_requestid(request->requestid());
-            req.mutable_filedata()->set_filename("");
-            req.mutable_filedata()->set_filesize(request->photo().size());
-            req.mutable_filedata()->set_filecontent(request->photo());
-            brpc::Controller cntl;
-            stub.PutSingleFile(&cntl, &req, &resp, nullptr);
-            if (cntl.Failed() == true || resp.success() == false)
-            {
-                ERROR("{} - 文件子服务调用失败：{}", request->requestid(), cntl.ErrorText());
+            // 相同的头像(例如默认头像)已存在时按摘要秒传，不再传输数据
+            std::string photo = request->photo();
+            std::string photoId;
+            if (!FileUploader::put(channel.get(), request->requestid(), uid, "", &photo, photoId))
                 return err(request->requestid(), "文件子服务调用失败");
-            }
-            std::string photoId = resp.fileinfo().fileid();
 
             // 更新数据库
             user->userPhotoId(photoId);
@@ -572,6 +572,9 @@ namespace hjb
                 return err(request->requestid(), "更新数据库用户头像失败");
             }
 
+            // 通知持有用户信息缓存的子服务失效该用户
+            UserProfileCache::publish(_redis, user->userId());
+
             // 更新es服务器
             if (!_es->appendData(user->userId(), user->phone(),
                                  user->nickname(), *user->desc(), *user->userPhotoId()))
@@ -628,6 +631,9 @@ namespace hjb
                 return err(request->requestid(), "更新数据库用户昵称失败");
             }
 
+            // 通知持有用户信息缓存的子服务失效该用户
+            UserProfileCache::publish(_redis, user->userId());
+
             // 更新es服务器
             if (!_es->appendData(user->userId(), user->phone(),
                                  user->nickname(), *user->desc(), *user->userPhotoId()))
@@ -681,6 +687,9 @@ namespace hjb
                 return err(request->requestid(), "更新数据库用户签名失败");
             }
 
+            // 通知持有用户信息缓存的子服务失效该用户
+            UserProfileCache::publish(_redis, user->userId());
+
             // 更新es服务器
             if (!_es->appendData(user->userId(), user->phone(),
                                  user->nickname(), *user->desc(), *user->userPhotoId()))
@@ -748,6 +757,9 @@ namespace hjb
                 return err(request->requestid(), "更新数据库用户手机失败");
             }
 
+            // 通知持有用户信息缓存的子服务失效该用户
+            UserProfileCache::publish(_redis, user->userId());
+
             // 更新es服务器
             if (!_es->appendData(user->userId(), user->phone(),
                                  user->nickname(), *user->desc(), *user->userPhotoId()))
@@ -810,6 +822,7 @@ namespace hjb
         std::shared_ptr<DMSClient> _dms;
         std::string _fileServiceName;
         hjb::AllServiceChannel::ptr _channels;
+        int _sessionTtl;
 
     public:
         // 构造es客户端对象
@@ -838,12 +851,15 @@ namespace hjb
         }
 
         // 构造redis客户端对象
+        // sessionTtl: 登录会话的过期时长(秒)，由网关根据长连接的存活情况续期
         void makeRedis(const std::string &host,
                        int port,
                        int db,
-                       bool keepAlive)
+                       bool keepAlive,
+                       int sessionTtl)
         {
             _redis = RedisClientFactory::create(host, port, db, keepAlive);
+            _sessionTtl = sessionTtl;
         }
 
         // 构造服务发现客户端和信道管理对象
@@ -853,7 +869,12 @@ namespace hjb
         {
             _fileServiceName = fileServiceName;
             _channels = std::make_shared<hjb::AllServiceChannel>();
-            _channels->declared(fileServiceName);
+            // 批量获取头像是幂等的读接口，开启请求对冲以削减尾延迟
+            // 文件服务需要传输头像数据，使用更长的时间预算
+            ServiceOptions fileOptions;
+            fileOptions.timeoutMs = 10000;
+            fileOptions.hedgedMethods = {"GetMultiFile"};
+            _channels->declared(fileServiceName, fileOptions);
 
             auto putCb = std::bind(&hjb::AllServiceChannel::onServiceOnline, _channels.get(), std::placeholders::_1, std::placeholders::_2);
             auto delCb = std::bind(&hjb::AllServiceChannel::onServiceOffline, _channels.get(), std::placeholders::_1, std::placeholders::_2);
@@ -900,7 +921,7 @@ namespace hjb
 
             _brpcServer = std::make_shared<brpc::Server>();
 
-            UserServiceImpl *service = new UserServiceImpl(_dms, _es, _mysql, _redis, _channels, _fileServiceName);
+            UserServiceImpl *service = new UserServiceImpl(_dms, _es, _mysql, _redis, _sessionTtl, _channels, _fileServiceName);
             if (_brpcServer->AddService(service, brpc::ServiceOwnership::SERVER_OWNS_SERVICE) == -1)
             {
                 ERROR("添加Rpc服务失败");